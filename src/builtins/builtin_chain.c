@@ -0,0 +1,265 @@
+// builtin_chain.c - `chain` loadable builtin
+//
+// `chain lines 1..100 f :: match X :: fields 2 :: trim` does what the
+// pipeline `lines 1..100 f | match X | fields 2 | trim` does, in one
+// process: no forked subshells and no pipe copies between stages. Every
+// line read is handed through the stages as a borrowed view.
+
+#include "diamondcore.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <signal.h>  // ANCHOR:SIGPIPE-INCLUDE
+
+// Bash loadable builtin headers (provided by bash source / headers)
+#include "config.h"
+#include "builtins.h"
+#include "shell.h"
+#include "dc_builtin.h"
+
+__attribute__((unused))
+static const char *chain_shortdoc = "chain [-A NAME] [--var NAME] STAGE [ARG] [--] [FILE...] [:: STAGE [ARG]]...";
+
+static char *chain_doc[] = {
+  "Run lines, match, fields and trim stages as one in-process pipeline.",
+  (char *)0,
+};
+
+static int chain_usage_err(const char *msg) {
+  if (msg && *msg) fprintf(stderr, "chain: %s\n", msg);
+  else dc_print_usage_chain(stderr);
+  return 2;
+}
+
+static int chain_io_err(const char *msg) {
+  if (msg && *msg) fprintf(stderr, "chain: %s\n", msg);
+  else fprintf(stderr, "chain: I/O error\n");
+  return 2;
+}
+
+static int chain_help(void) {
+  dc_print_usage_chain(stdout);
+  return 0;
+}
+
+static int chain_main(dc_stage_t **stages, size_t nstages, bool first_is_lines,
+                      char *const *files, size_t file_count, dc_bi_array_t *arr,
+                      const dc_bi_input_t *in) {
+  dc_error_t err;
+  dc_line_reader_t *lr = dc_bi_lr_open(in, files, file_count, &err);
+  if (!lr) return chain_io_err(err.msg[0] ? err.msg : "cannot open input");
+
+  dc_out_t *out = dc_bi_out_open(arr, &err);
+  if (!out) {
+    dc_lr_close(lr);
+    return chain_io_err(err.msg[0] ? err.msg : "out of memory");
+  }
+
+  dc_lr_set_refill_hook(lr, dc_bi_flush_on_refill, out);
+  // Valid FILE.dcidx sidecars let a leading lines stage seek.
+  if (first_is_lines) dc_lr_use_index(lr, true);
+
+  bool emitted = false;
+  int rc = 0;
+
+  for (;;) {
+    // Lines a leading lines stage would drop are never read one by one.
+    uint64_t skip = dc_stage_skippable(stages[0]);
+    if (skip > 0) {
+      uint64_t skipped = 0;
+      if (!dc_lr_skip(lr, skip, &skipped, &err)) {
+        rc = chain_io_err(err.msg[0] ? err.msg : "read error");
+        goto done;
+      }
+      dc_stage_skipped(stages[0], skipped);
+      if (skipped < skip) break; // EOF
+    }
+
+    dc_line_view_t v;
+    if (!dc_lr_next(lr, &v, &err)) {
+      if (err.code != DC_ERR_NONE) {
+        rc = chain_io_err(err.msg[0] ? err.msg : "read error");
+        goto done;
+      }
+      break; // EOF
+    }
+
+    dc_stage_result_t r = DC_STAGE_PASS;
+    for (size_t i = 0; i < nstages && r == DC_STAGE_PASS; i++) r = dc_stage_apply(stages[i], &v, &err);
+    if (r == DC_STAGE_DONE) break;
+    if (r == DC_STAGE_ERROR) {
+      rc = chain_io_err(err.msg[0] ? err.msg : "stage error");
+      goto done;
+    }
+    if (r == DC_STAGE_DROP) continue;
+
+    if (!dc_out_write(out, v.ptr, v.len, &err)) {
+      rc = chain_io_err(err.msg[0] ? err.msg : "write error");
+      goto done;
+    }
+    emitted = true;
+  }
+
+  rc = emitted ? 0 : 1;
+
+done:
+  if (!dc_out_close(out, &err) && rc != 2) {
+    rc = chain_io_err(err.msg[0] ? err.msg : "write error");
+  }
+  dc_lr_close(lr);
+  return rc;
+}
+
+// Parsing rules:
+// - `::` separates stages; each stage is a builtin name followed by its
+//   usual arguments: lines SPEC, match PATTERN, fields SPEC, trim.
+// - Within a stage, `--` ends options and any other -x token is an error,
+//   except a SPEC starting with "-DIGIT".
+// - Only the first stage may name FILEs; later stages read the previous
+//   stage's output.
+// - --help is recognized as the first token only; -A NAME and --var NAME
+//   only before the first stage.
+__attribute__((visibility("default")))
+int chain_builtin(WORD_LIST *list) {
+  // === ANCHOR:SIGPIPE-BEGIN ===
+  // Ignore SIGPIPE so closed-pipe writes surface as stdio errors (EPIPE) and we return 2.
+  void (*old_sigpipe)(int) = signal(SIGPIPE, SIG_IGN);
+  // === ANCHOR:SIGPIPE-END ===
+
+  size_t scap = 4, nstages = 0;
+  dc_stage_t **stages = (dc_stage_t **)calloc(scap, sizeof(*stages));
+  size_t fcap = 8, fcnt = 0;
+  char **files = (char **)calloc(fcap, sizeof(char *));
+  bool first_is_lines = false;
+  const char *array_name = NULL;
+  const char *var_name = NULL;
+  dc_bi_input_t in = { .copy = NULL };
+  int rc = 2; // default error unless set
+
+  if (!stages || !files) {
+    rc = chain_io_err("out of memory");
+    goto out;
+  }
+  if (list && list->word->word && strcmp(list->word->word, "--help") == 0) {
+    rc = chain_help();
+    goto out;
+  }
+  for (; list; list = list->next) {
+    int a = dc_bi_io_opt(&list, &array_name, &var_name);
+    if (a < 0) {
+      rc = chain_usage_err("missing NAME after -A / --var");
+      goto out;
+    }
+    if (a == 0) break;
+  }
+  if (!list) {
+    rc = chain_usage_err("missing STAGE");
+    goto out;
+  }
+
+  for (WORD_LIST *w = list; w;) {
+    const char *name = w->word->word ? w->word->word : "";
+    if (strcmp(name, "::") == 0) {
+      rc = chain_usage_err("empty stage");
+      goto out;
+    }
+    w = w->next;
+
+    bool takes_arg = dc_stage_takes_arg(name);
+    bool end_opts = false;
+    const char *arg = NULL;
+
+    for (; w; w = w->next) {
+      const char *tok = w->word->word ? w->word->word : "";
+      if (strcmp(tok, "::") == 0) {
+        w = w->next;
+        if (!w) {
+          rc = chain_usage_err("empty stage");
+          goto out;
+        }
+        break;
+      }
+      if (!end_opts && strcmp(tok, "--") == 0) {
+        end_opts = true;
+        continue;
+      }
+      bool numeric = tok[0] == '-' && tok[1] >= '0' && tok[1] <= '9';
+      if (!end_opts && tok[0] == '-' && tok[1] != '\0' && !(numeric && takes_arg && !arg)) {
+        rc = chain_usage_err("unknown option (use --help)");
+        goto out;
+      }
+      if (takes_arg && !arg) {
+        arg = tok;
+        continue;
+      }
+      if (nstages > 0) {
+        rc = chain_usage_err("only the first stage takes FILE operands");
+        goto out;
+      }
+      if (fcnt == fcap) {
+        size_t ncap = fcap * 2;
+        char **nf = (char **)realloc(files, ncap * sizeof(char *));
+        if (!nf) {
+          rc = chain_io_err("out of memory");
+          goto out;
+        }
+        files = nf;
+        fcap = ncap;
+      }
+      files[fcnt++] = (char *)tok;
+    }
+
+    if (takes_arg && !arg) {
+      fprintf(stderr, "chain: %s: missing %s\n", name, strcmp(name, "match") == 0 ? "PATTERN" : "SPEC");
+      rc = 2;
+      goto out;
+    }
+
+    if (nstages == scap) {
+      size_t ncap = scap * 2;
+      dc_stage_t **ns = (dc_stage_t **)realloc(stages, ncap * sizeof(*ns));
+      if (!ns) {
+        rc = chain_io_err("out of memory");
+        goto out;
+      }
+      stages = ns;
+      scap = ncap;
+    }
+    dc_error_t err;
+    stages[nstages] = dc_stage_new(name, arg, &err);
+    if (!stages[nstages]) {
+      rc = err.code == DC_ERR_NOMEM ? chain_io_err(err.msg) : chain_usage_err(err.msg);
+      goto out;
+    }
+    if (nstages == 0) first_is_lines = strcmp(name, "lines") == 0;
+    nstages++;
+  }
+
+  dc_bi_array_t arr;
+  if (!dc_bi_io_begin("chain", array_name, var_name, fcnt, &arr, &in)) goto out;
+  rc = chain_main(stages, nstages, first_is_lines, files, fcnt, array_name ? &arr : NULL,
+                  var_name ? &in : NULL);
+
+out:
+  // === ANCHOR:CLEANUP-BEGIN ===
+  for (size_t i = 0; i < nstages; i++) dc_stage_free(stages[i]);
+  free(stages);
+  free(files);
+  dc_bi_input_free(&in);
+  signal(SIGPIPE, old_sigpipe);
+  return rc;
+  // === ANCHOR:CLEANUP-END ===
+}
+
+__attribute__((visibility("default")))
+struct builtin chain_struct = {
+  .name = "chain",
+  .function = chain_builtin,
+  .flags = BUILTIN_ENABLED,
+  .long_doc = chain_doc,
+  .short_doc = (char *)"chain [-A NAME] [--var NAME] STAGE [ARG] [--] [FILE...] [:: STAGE [ARG]]...",
+  .handle = 0,
+};
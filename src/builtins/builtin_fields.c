@@ -13,9 +13,10 @@
 #include "config.h"
 #include "builtins.h"
 #include "shell.h"
+#include "dc_builtin.h"
 
 __attribute__((unused))
-static const char *fields_shortdoc = "fields SPEC [--] [FILE...]";
+static const char *fields_shortdoc = "fields [-A NAME] [--var NAME] SPEC [--] [FILE...]";
 
 static char *fields_doc[] = {
   "Select and emit specific 1-based fields from each input line.",
@@ -42,7 +43,8 @@ static int fields_help(void) {
 // === ANCHOR:ERROR-HELPERS-END ===
 
 // === ANCHOR:CORE-MAIN-BEGIN ===
-static int fields_main(const char *spec, char *const *files, size_t file_count) {
+static int fields_main(const char *spec, char *const *files, size_t file_count, dc_bi_array_t *arr,
+                       const dc_bi_input_t *in) {
   dc_error_t err;
   dc_sel_t *sel = dc_sel_parse_and_normalize(spec, &err);
   if (!sel) {
@@ -52,96 +54,77 @@ static int fields_main(const char *spec, char *const *files, size_t file_count)
   bool has_max = false;
   uint64_t max_finite = dc_sel_max_finite(sel, &has_max);
 
-  dc_line_reader_t *lr = dc_lr_open(files, file_count, &err);
+  // Fields past the highest finite index are never emitted: stop there.
+  // (No such bound exists once any field is counted from the end.)
+  size_t split_max = 0;
+  if (has_max) split_max = max_finite < (uint64_t)SIZE_MAX ? (size_t)max_finite : 0;
+
+  dc_line_reader_t *lr = dc_bi_lr_open(in, files, file_count, &err);
   if (!lr) {
     dc_sel_free(sel);
     return fields_io_err(err.msg[0] ? err.msg : "cannot open input");
   }
 
+  dc_out_t *out = dc_bi_out_open(arr, &err);
+  if (!out) {
+    dc_lr_close(lr);
+    dc_sel_free(sel);
+    return fields_io_err(err.msg[0] ? err.msg : "out of memory");
+  }
+
+  dc_lr_set_refill_hook(lr, dc_bi_flush_on_refill, out);
+
   bool emitted_any = false;
+  int rc = 0;
+  dc_field_view_t *fields = NULL; // reused for every line
+  size_t fields_cap = 0;
 
   for (;;) {
     dc_line_view_t v;
     bool ok = dc_lr_next(lr, &v, &err);
     if (!ok) {
       if (err.code != DC_ERR_NONE) {
-        dc_lr_close(lr);
-        dc_sel_free(sel);
-        return fields_io_err(err.msg[0] ? err.msg : "read error");
+        rc = fields_io_err(err.msg[0] ? err.msg : "read error");
+        goto done;
       }
       break; // EOF
     }
 
-    dc_field_view_t *fields = NULL;
-    size_t nfields = dc_split_ws(v.ptr, v.len, &fields);
-    if (nfields == (size_t)-1) {
-      dc_lr_close(lr);
-      dc_sel_free(sel);
-      return fields_io_err("out of memory");
+    // Compact the selected views to the front, then emit them in one join.
+    size_t nsel = dc_fields_select(sel, v.ptr, v.len, split_max, &fields, &fields_cap);
+    if (nsel == (size_t)-1) {
+      rc = fields_io_err("out of memory");
+      goto done;
     }
-    if (nfields == 0) {
-      free(fields);
-      continue;
-    }
-
-    bool emitted_line = false;
-    bool first = true;
-
-    size_t limit = nfields;
-    if (has_max && max_finite < (uint64_t)limit) limit = (size_t)max_finite;
-
-    for (size_t i = 0; i < limit; i++) {
-      uint64_t idx = (uint64_t)(i + 1);
-      if (!dc_sel_wants(sel, idx)) continue;
-
-      if (!first) {
-        if (fputc(' ', stdout) == EOF) {
-          free(fields);
-          dc_lr_close(lr);
-          dc_sel_free(sel);
-          return fields_io_err("write error");
-        }
-      }
 
-      const uint8_t *p = fields[i].ptr;
-      size_t n = fields[i].len;
-      if (n > 0) {
-        size_t w = fwrite(p, 1, n, stdout);
-        if (w != n) {
-          free(fields);
-          dc_lr_close(lr);
-          dc_sel_free(sel);
-          return fields_io_err("write error");
-        }
+    if (nsel > 0) {
+      if (!dc_out_join(out, fields, nsel, DC_FIELDS_SEP, &err) ||
+          (v.ends_with_nl && !dc_out_putc(out, (uint8_t)'\n', &err))) {
+        rc = fields_io_err(err.msg[0] ? err.msg : "write error");
+        goto done;
       }
-
-      first = false;
-      emitted_line = true;
       emitted_any = true;
     }
+  }
 
-    if (emitted_line && v.ends_with_nl) {
-      if (fputc('\n', stdout) == EOF) {
-        free(fields);
-        dc_lr_close(lr);
-        dc_sel_free(sel);
-        return fields_io_err("write error");
-      }
-    }
+  rc = emitted_any ? 0 : 1;
 
-    free(fields);
+done:
+  free(fields);
+  if (!dc_out_close(out, &err) && rc != 2) {
+    rc = fields_io_err(err.msg[0] ? err.msg : "write error");
   }
-
   dc_lr_close(lr);
   dc_sel_free(sel);
-  return emitted_any ? 0 : 1;
+  return rc;
 }
 // === ANCHOR:CORE-MAIN-END ===
 
 // Parsing rules:
-// - Only --help is recognized.
+// - Only --help, -A NAME and --var NAME are recognized.
 // - Any other -x token is an error unless after --, or token is exactly '-'.
-// - SPEC is required and is the first non-option token.
+// - SPEC is required and is the first non-option token; a SPEC may start
+//   with "-DIGIT" (counted from the last field).
 __attribute__((visibility("default")))
 int fields_builtin(WORD_LIST *list) {
   // === ANCHOR:SIGPIPE-BEGIN ===
@@ -151,6 +134,9 @@ int fields_builtin(WORD_LIST *list) {
 
   bool end_opts = false;
   const char *spec = NULL;
+  const char *array_name = NULL;
+  const char *var_name = NULL;
+  dc_bi_input_t in = { .copy = NULL };
 
   size_t fcap = 8;
   size_t fcnt = 0;
@@ -167,6 +153,15 @@ int fields_builtin(WORD_LIST *list) {
     const char *tok = w->word->word;
     if (!tok) tok = "";
 
+    if (!end_opts) {
+      int a = dc_bi_io_opt(&w, &array_name, &var_name);
+      if (a < 0) {
+        rc = fields_usage_err("missing NAME after -A / --var");
+        goto out;
+      }
+      if (a > 0) continue;
+    }
+
     if (!spec) {
       if (!end_opts && strcmp(tok, "--help") == 0) {
         rc = fields_help();
@@ -177,7 +172,8 @@ int fields_builtin(WORD_LIST *list) {
         continue;
       }
 
-      if (!end_opts && tok[0] == '-' && tok[1] != '\0' && strcmp(tok, "-") != 0) {
+      // "-N..." is a SPEC counting from the last field, never an option.
+      if (!end_opts && tok[0] == '-' && tok[1] != '\0' && !(tok[1] >= '0' && tok[1] <= '9')) {
         rc = fields_usage_err("unknown option (use --help)");
         goto out;
       }
@@ -215,10 +211,13 @@ int fields_builtin(WORD_LIST *list) {
     goto out;
   }
 
-  rc = fields_main(spec, files, fcnt);
+  dc_bi_array_t arr;
+  if (!dc_bi_io_begin("fields", array_name, var_name, fcnt, &arr, &in)) goto out;
+  rc = fields_main(spec, files, fcnt, array_name ? &arr : NULL, var_name ? &in : NULL);
 
 out:
   // === ANCHOR:CLEANUP-BEGIN ===
+  dc_bi_input_free(&in);
   free(files);
   signal(SIGPIPE, old_sigpipe);
   return rc;
@@ -231,6 +230,6 @@ struct builtin fields_struct = {
   .function = fields_builtin,
   .flags = BUILTIN_ENABLED,
   .long_doc = fields_doc,
-  .short_doc = (char *)"fields SPEC [--] [FILE...]",
+  .short_doc = (char *)"fields [-A NAME] [--var NAME] SPEC [--] [FILE...]",
   .handle = 0,
 };
@@ -14,9 +14,10 @@
 #include "config.h"
 #include "builtins.h"
 #include "shell.h"
+#include "dc_builtin.h"
 
 __attribute__((unused))
-static const char *lines_shortdoc = "lines SPEC [--] [FILE...]";
+static const char *lines_shortdoc = "lines [-A NAME] [--var NAME] SPEC [--] [FILE...]";
 
 static char *lines_doc[] = {
   "Select and emit specific 1-based input lines by numeric index or range.",
@@ -40,66 +41,260 @@ static int lines_help(void) {
   return 0;
 }
 
-static int lines_main(const char *spec, char *const *files, size_t file_count) {
+/* Emit every line the (absolute) selection wants; the common path. */
+static int lines_select(dc_sel_t *sel, dc_line_reader_t *lr, dc_out_t *out, bool *emitted) {
   dc_error_t err;
-  dc_sel_t *sel = dc_sel_parse_and_normalize(spec, &err);
-  if (!sel) {
-    return lines_usage_err(err.msg[0] ? err.msg : "invalid SPEC");
+  uint64_t line_no = 0;
+
+  for (;;) {
+    uint64_t want = dc_sel_next(sel, line_no + 1);
+    if (want == 0) break; // proven no future lines needed
+
+    if (want > line_no + 1) {
+      uint64_t skipped = 0;
+      if (!dc_lr_skip(lr, want - line_no - 1, &skipped, &err)) {
+        return lines_io_err(err.msg[0] ? err.msg : "read error");
+      }
+      line_no += skipped;
+      if (line_no + 1 < want) break; // EOF
+    }
+
+    dc_line_view_t v;
+    bool ok = dc_lr_next(lr, &v, &err);
+    if (!ok) {
+      if (err.code != DC_ERR_NONE) return lines_io_err(err.msg[0] ? err.msg : "read error");
+      break; // EOF
+    }
+
+    line_no++;
+
+    if (!dc_out_write(out, v.ptr, v.len, &err)) {
+      return lines_io_err(err.msg[0] ? err.msg : "write error");
+    }
+    *emitted = true;
+  }
+  return 0;
+}
+
+/* Regular files, every item counted from the end: scan backward for the
+ * last SPAN lines and read only those. */
+static int lines_tail(dc_sel_t *sel, uint64_t span, dc_line_reader_t *lr, dc_out_t *out,
+                      bool *emitted) {
+  dc_error_t err;
+  uint64_t found = 0;
+  if (!dc_lr_seek_tail(lr, span, &found, &err)) {
+    return lines_io_err(err.msg[0] ? err.msg : "read error");
+  }
+
+  for (uint64_t i = 1; i <= found; i++) {
+    dc_line_view_t v;
+    if (!dc_lr_next(lr, &v, &err)) {
+      if (err.code != DC_ERR_NONE) return lines_io_err(err.msg[0] ? err.msg : "read error");
+      break; // the file shrank
+    }
+    if (!dc_sel_wants_at(sel, i, found)) continue;
+    if (!dc_out_write(out, v.ptr, v.len, &err)) {
+      return lines_io_err(err.msg[0] ? err.msg : "write error");
+    }
+    *emitted = true;
   }
+  return 0;
+}
 
-  bool has_max = false;
-  uint64_t max_finite = dc_sel_max_finite(sel, &has_max);
+/* Sliding window over the most recent lines of a stream, stored back to
+ * back in BUF; OFFS[first..nlines) are their start offsets. Consumed
+ * space is reclaimed by sliding both arrays down when they fill up. */
+typedef struct {
+  uint8_t *buf;
+  size_t cap;
+  size_t end;
+  size_t *offs;
+  size_t offs_cap;
+  size_t first;
+  size_t nlines;
+} line_window_t;
 
-  dc_line_reader_t *lr = dc_lr_open(files, file_count, &err);
-  if (!lr) {
-    dc_sel_free(sel);
-    return lines_io_err(err.msg[0] ? err.msg : "cannot open input");
+static size_t window_count(const line_window_t *w) { return w->nlines - w->first; }
+
+static bool window_push(line_window_t *w, const uint8_t *p, size_t len) {
+  if (w->first > 0 && (w->nlines == w->offs_cap || w->cap - w->end < len)) {
+    size_t base = w->first < w->nlines ? w->offs[w->first] : w->end;
+    memmove(w->buf, w->buf + base, w->end - base);
+    w->end -= base;
+    for (size_t i = w->first; i < w->nlines; i++) w->offs[i - w->first] = w->offs[i] - base;
+    w->nlines -= w->first;
+    w->first = 0;
+  }
+  if (w->nlines == w->offs_cap) {
+    size_t ncap = w->offs_cap ? w->offs_cap * 2 : 64;
+    size_t *no = (size_t *)realloc(w->offs, ncap * sizeof(size_t));
+    if (!no) return false;
+    w->offs = no;
+    w->offs_cap = ncap;
+  }
+  if (w->cap - w->end < len) {
+    size_t ncap = w->cap ? w->cap : 4096;
+    while (ncap - w->end < len) ncap *= 2;
+    uint8_t *nb = (uint8_t *)realloc(w->buf, ncap);
+    if (!nb) return false;
+    w->buf = nb;
+    w->cap = ncap;
   }
+  w->offs[w->nlines++] = w->end;
+  memcpy(w->buf + w->end, p, len);
+  w->end += len;
+  return true;
+}
+
+/* Remove the oldest line; its bytes stay valid until the next push. */
+static void window_pop(line_window_t *w, const uint8_t **p, size_t *len) {
+  size_t i = w->first++;
+  size_t stop = i + 1 < w->nlines ? w->offs[i + 1] : w->end;
+  *p = w->buf + w->offs[i];
+  *len = stop - w->offs[i];
+}
 
+/* Streams: hold back the last SPAN lines. A line that falls out of the
+ * window is more than SPAN from the end, which settles every "-N" bound. */
+static int lines_window(dc_sel_t *sel, uint64_t span, dc_line_reader_t *lr, dc_out_t *out,
+                        bool *emitted) {
+  dc_error_t err;
+  line_window_t w;
+  memset(&w, 0, sizeof(w));
   uint64_t line_no = 0;
-  bool emitted = false;
+  int rc = 0;
 
   for (;;) {
     dc_line_view_t v;
-    bool ok = dc_lr_next(lr, &v, &err);
-    if (!ok) {
+    if (!dc_lr_next(lr, &v, &err)) {
       if (err.code != DC_ERR_NONE) {
-        dc_lr_close(lr);
-        dc_sel_free(sel);
-        return lines_io_err(err.msg[0] ? err.msg : "read error");
+        rc = lines_io_err(err.msg[0] ? err.msg : "read error");
+        goto done;
       }
       break; // EOF
     }
-
     line_no++;
 
-    if (dc_sel_wants(sel, line_no)) {
-      if (v.len > 0) {
-        size_t n = fwrite(v.ptr, 1, v.len, stdout);
-        if (n != v.len) {
-          dc_lr_close(lr);
-          dc_sel_free(sel);
-          return lines_io_err("write error");
+    if (window_count(&w) == span) {
+      const uint8_t *p;
+      size_t len;
+      window_pop(&w, &p, &len);
+      if (dc_sel_wants_at(sel, line_no - span, line_no)) {
+        if (!dc_out_write(out, p, len, &err)) {
+          rc = lines_io_err(err.msg[0] ? err.msg : "write error");
+          goto done;
         }
+        *emitted = true;
       }
-      emitted = true;
     }
+    if (!window_push(&w, v.ptr, v.len)) {
+      rc = lines_io_err("out of memory");
+      goto done;
+    }
+  }
+
+  // EOF: the total is known, so the held lines are decided exactly.
+  for (uint64_t n = line_no - window_count(&w) + 1; window_count(&w) > 0; n++) {
+    const uint8_t *p;
+    size_t len;
+    window_pop(&w, &p, &len);
+    if (!dc_sel_wants_at(sel, n, line_no)) continue;
+    if (!dc_out_write(out, p, len, &err)) {
+      rc = lines_io_err(err.msg[0] ? err.msg : "write error");
+      goto done;
+    }
+    *emitted = true;
+  }
+
+done:
+  free(w.buf);
+  free(w.offs);
+  return rc;
+}
+
+static int lines_main(const char *spec, char *const *files, size_t file_count, dc_bi_array_t *arr,
+                      const dc_bi_input_t *in) {
+  dc_error_t err;
+  dc_sel_t *sel = dc_sel_parse_and_normalize(spec, &err);
+  if (!sel) {
+    return lines_usage_err(err.msg[0] ? err.msg : "invalid SPEC");
+  }
+
+  dc_line_reader_t *lr = dc_bi_lr_open(in, files, file_count, &err);
+  if (!lr) {
+    dc_sel_free(sel);
+    return lines_io_err(err.msg[0] ? err.msg : "cannot open input");
+  }
+
+  dc_out_t *out = dc_bi_out_open(arr, &err);
+  if (!out) {
+    dc_lr_close(lr);
+    dc_sel_free(sel);
+    return lines_io_err(err.msg[0] ? err.msg : "out of memory");
+  }
 
-    if (has_max && line_no >= max_finite) {
-      // Proven no future lines needed.
-      break;
+  dc_lr_set_refill_hook(lr, dc_bi_flush_on_refill, out);
+
+  // Valid FILE.dcidx sidecars let skips seek instead of reading.
+  dc_lr_use_index(lr, true);
+
+  bool emitted = false;
+  int rc = 0;
+  uint64_t span = dc_sel_tail_span(sel);
+
+  if (span == 0) {
+    rc = lines_select(sel, lr, out, &emitted);
+  } else if (!dc_lr_inputs_regular(lr)) {
+    rc = lines_window(sel, span, lr, out, &emitted);
+  } else if (dc_sel_tail_only(sel)) {
+    rc = lines_tail(sel, span, lr, out, &emitted);
+  } else {
+    // Regular files with mixed bounds: count the lines (cheap, and free
+    // with an index), then select as usual.
+    uint64_t total = 0;
+    dc_line_reader_t *cnt = dc_lr_open(files, file_count, &err);
+    if (cnt) {
+      dc_lr_use_index(cnt, true);
+      if (!dc_lr_skip(cnt, UINT64_MAX, &total, &err)) {
+        rc = lines_io_err(err.msg[0] ? err.msg : "read error");
+      }
+      dc_lr_close(cnt);
+    } else {
+      rc = lines_io_err(err.msg[0] ? err.msg : "out of memory");
+    }
+    if (rc == 0) {
+      dc_sel_resolve(sel, total);
+      rc = lines_select(sel, lr, out, &emitted);
     }
   }
 
+  if (rc == 0) rc = emitted ? 0 : 1;
+
+  if (!dc_out_close(out, &err) && rc != 2) {
+    rc = lines_io_err(err.msg[0] ? err.msg : "write error");
+  }
   dc_lr_close(lr);
   dc_sel_free(sel);
-  return emitted ? 0 : 1;
+  return rc;
+}
+
+// `lines --index FILE...`: build or refresh the sidecar index of each FILE.
+static int lines_build_index(char *const *files, size_t file_count) {
+  if (file_count == 0) return lines_usage_err("missing FILE");
+
+  int rc = 0;
+  for (size_t i = 0; i < file_count; i++) {
+    dc_error_t err;
+    if (!dc_lineidx_build(files[i], &err)) rc = lines_io_err(err.msg[0] ? err.msg : "cannot build index");
+  }
+  return rc;
 }
 
 // Parsing rules:
-// - Only --help is recognized.
+// - Only --help, --index, -A NAME and --var NAME are recognized.
 // - Any other -x token is an error unless after --, or token is exactly '-'.
-// - SPEC is required and is the first non-option token.
+// - SPEC is required and is the first non-option token; a SPEC may start
+//   with "-DIGIT" (counted from the end).
 __attribute__((visibility("default")))
 int lines_builtin(WORD_LIST *list) {
   // === ANCHOR:SIGPIPE-BEGIN ===
@@ -108,7 +303,11 @@ int lines_builtin(WORD_LIST *list) {
   // === ANCHOR:SIGPIPE-END ===
 
   bool end_opts = false;
+  bool index_mode = false;
   const char *spec = NULL;
+  const char *array_name = NULL;
+  const char *var_name = NULL;
+  dc_bi_input_t in = { .copy = NULL };
 
   size_t fcap = 8;
   size_t fcnt = 0;
@@ -125,17 +324,31 @@ int lines_builtin(WORD_LIST *list) {
     const char *tok = w->word->word;
     if (!tok) tok = "";
 
-    if (!spec) {
+    if (!end_opts) {
+      int a = dc_bi_io_opt(&w, &array_name, &var_name);
+      if (a < 0) {
+        rc = lines_usage_err("missing NAME after -A / --var");
+        goto out;
+      }
+      if (a > 0) continue;
+    }
+
+    if (!spec && !index_mode) {
       if (!end_opts && strcmp(tok, "--help") == 0) {
         rc = lines_help();
         goto out;
       }
+      if (!end_opts && strcmp(tok, "--index") == 0) {
+        index_mode = true;
+        continue;
+      }
       if (!end_opts && strcmp(tok, "--") == 0) {
         end_opts = true;
         continue;
       }
 
-      if (!end_opts && tok[0] == '-' && tok[1] != '\0' && strcmp(tok, "-") != 0) {
+      // "-N..." is a SPEC counting from the end, never an option.
+      if (!end_opts && tok[0] == '-' && tok[1] != '\0' && !(tok[1] >= '0' && tok[1] <= '9')) {
         rc = lines_usage_err("unknown option (use --help)");
         goto out;
       }
@@ -167,15 +380,23 @@ int lines_builtin(WORD_LIST *list) {
   }
   // === ANCHOR:ARGV-PARSE-END ===
 
+  if (index_mode) {
+    rc = lines_build_index(files, fcnt);
+    goto out;
+  }
+
   if (!spec) {
     rc = lines_usage_err("missing SPEC");
     goto out;
   }
 
-  rc = lines_main(spec, files, fcnt);
+  dc_bi_array_t arr;
+  if (!dc_bi_io_begin("lines", array_name, var_name, fcnt, &arr, &in)) goto out;
+  rc = lines_main(spec, files, fcnt, array_name ? &arr : NULL, var_name ? &in : NULL);
 
 out:
   // === ANCHOR:CLEANUP-BEGIN ===
+  dc_bi_input_free(&in);
   free(files);
   signal(SIGPIPE, old_sigpipe);
   return rc;
@@ -188,6 +409,6 @@ struct builtin lines_struct = {
   .function = lines_builtin,
   .flags = BUILTIN_ENABLED,
   .long_doc = lines_doc,
-  .short_doc = (char *)"lines SPEC [--] [FILE...]",
+  .short_doc = (char *)"lines [-A NAME] [--var NAME] SPEC [--] [FILE...]",
   .handle = 0,
 };
@@ -8,14 +8,16 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <unistd.h>  /* sysconf */
 #include <signal.h>  // ANCHOR:SIGPIPE-INCLUDE
 
 #include "config.h"
 #include "builtins.h"
 #include "shell.h"
+#include "dc_builtin.h"
 
 __attribute__((unused))
-static const char *match_shortdoc = "match PATTERN [--] [FILE...]";
+static const char *match_shortdoc = "match [-A NAME] [--var NAME] PATTERN | -e PATTERN... | -f FILE [--] [FILE...]";
 
 static char *match_doc[] = {
   "Filter input lines by a deterministic, constrained regex.",
@@ -39,88 +41,186 @@ static int match_help(void) {
   return 0;
 }
 
-static int match_main(const char *pattern, char *const *files, size_t file_count) {
+// Compiled patterns are cached across calls (see dc_regex_cache_get);
+// these report on and empty that cache.
+static int match_cache_stats(void) {
+  dc_regex_cache_stats_t st;
+  dc_regex_cache_stats(&st);
+  printf("entries %zu\nbytes %zu\nhits %llu\nmisses %llu\nevictions %llu\n", st.entries, st.bytes,
+         (unsigned long long)st.hits, (unsigned long long)st.misses, (unsigned long long)st.evictions);
+  return fflush(stdout) == 0 ? 0 : match_io_err("write error");
+}
+
+static int match_cache_clear(void) {
+  dc_regex_cache_clear();
+  return 0;
+}
+
+typedef struct {
+  dc_out_t *out;
+  const dc_line_reader_t *lr;
+  dc_error_t *err;
+  bool emitted;
+} match_sink_t;
+
+static bool match_emit(void *arg, const uint8_t *line, size_t len) {
+  match_sink_t *sink = (match_sink_t *)arg;
+  // Workers read the block long after the reader handed it out; a file
+  // truncated meanwhile must not turn into lines of NUL bytes.
+  if (!dc_lr_intact(sink->lr, sink->err)) return false;
+  sink->emitted = true;
+  return dc_out_write(sink->out, line, len, sink->err);
+}
+
+// Worker threads for large blocks (mapped regular files): MATCH_THREADS
+// if set, else the number of online CPUs.
+static int match_threads(void) {
+  const char *env = getenv("MATCH_THREADS");
+  if (env && *env) {
+    char *end = NULL;
+    long n = strtol(env, &end, 10);
+    if (end && *end == '\0' && n >= 1) return n > 256 ? 256 : (int)n;
+  }
+  long n = sysconf(_SC_NPROCESSORS_ONLN);
+  return n < 1 ? 1 : (n > 256 ? 256 : (int)n);
+}
+
+// Patterns given with -e / -f, copied. An empty one matches every line,
+// as `match ''` does, so it is not stored: it turns the set into "select
+// all" (ALL) and the other patterns no longer matter.
+typedef struct {
+  char **p;
+  size_t n;
+  size_t cap;
+  bool all;
+} match_pats_t;
+
+static int match_pats_add(match_pats_t *ps, const char *s, size_t len) {
+  if (len == 0) {
+    ps->all = true;
+    return 0;
+  }
+  if (ps->n == ps->cap) {
+    size_t ncap = ps->cap ? ps->cap * 2 : 8;
+    char **np = (char **)realloc(ps->p, ncap * sizeof(char *));
+    if (!np) return match_io_err("out of memory");
+    ps->p = np;
+    ps->cap = ncap;
+  }
+  char *c = (char *)malloc(len + 1);
+  if (!c) return match_io_err("out of memory");
+  memcpy(c, s, len);
+  c[len] = '\0';
+  ps->p[ps->n++] = c;
+  return 0;
+}
+
+static void match_pats_free(match_pats_t *ps) {
+  for (size_t i = 0; i < ps->n; i++) free(ps->p[i]);
+  free(ps->p);
+}
+
+// -f FILE: one pattern per line, without its newline; `-` is stdin.
+static int match_pats_read(match_pats_t *ps, const char *path) {
+  dc_error_t err;
+  char *files[1] = { (char *)path };
+  dc_line_reader_t *lr = dc_lr_open(files, 1, &err);
+  if (!lr) return match_io_err(err.msg[0] ? err.msg : "cannot open pattern file");
+  int rc = 0;
+  dc_line_view_t v;
+  while (dc_lr_next(lr, &v, &err)) {
+    size_t len = v.len - (v.ends_with_nl ? 1 : 0);
+    if ((rc = match_pats_add(ps, (const char *)v.ptr, len)) != 0) break;
+  }
+  if (rc == 0 && err.code != DC_ERR_NONE) rc = match_io_err(err.msg[0] ? err.msg : "read error");
+  dc_lr_close(lr);
+  return rc;
+}
+
+static void match_release(dc_regex_t *re, bool cached) {
+  if (cached) dc_regex_cache_put(re);
+  else dc_regex_free(re);
+}
+
+static int match_main(const char *const *patterns, size_t npatterns, char *const *files, size_t file_count,
+                      dc_bi_array_t *arr, const dc_bi_input_t *in) {
   char errbuf[256];
   dc_regex_t *re = NULL;
 
-  if (!dc_regex_compile(&re, pattern, errbuf)) {
+  // A single pattern goes through the session cache; a set is compiled
+  // for this call only.
+  bool cached = npatterns == 1;
+  if (cached ? !dc_regex_cache_get(&re, patterns[0], errbuf)
+             : !dc_regex_compile_set(&re, patterns, npatterns, errbuf)) {
     if (errbuf[0]) fprintf(stderr, "%s\n", errbuf);
     else fprintf(stderr, "match: pattern compile error\n");
     return 2;
   }
 
   dc_error_t err;
-  dc_line_reader_t *lr = dc_lr_open(files, file_count, &err);
+  dc_line_reader_t *lr = dc_bi_lr_open(in, files, file_count, &err);
   if (!lr) {
-    dc_regex_free(re);
+    match_release(re, cached);
     return match_io_err(err.msg[0] ? err.msg : "cannot open input");
   }
 
-  bool emitted = false;
+  dc_out_t *out = dc_bi_out_open(arr, &err);
+  if (!out) {
+    dc_lr_close(lr);
+    match_release(re, cached);
+    return match_io_err(err.msg[0] ? err.msg : "out of memory");
+  }
+
+  dc_lr_set_refill_hook(lr, dc_bi_flush_on_refill, out);
 
+  match_sink_t sink = { .out = out, .lr = lr, .err = &err, .emitted = false };
+  int nthreads = match_threads();
+  int rc = 0;
+
+  // Scan whole blocks of lines: lines without the pattern's required
+  // literal are skipped inside the regex engine, not handed over one by one,
+  // and a mapped file is split across worker threads.
   for (;;) {
-    dc_line_view_t v;
-    bool ok = dc_lr_next(lr, &v, &err);
+    dc_line_view_t blk;
+    bool ok = dc_lr_next_block(lr, &blk, &err);
     if (!ok) {
       if (err.code != DC_ERR_NONE) {
-        dc_lr_close(lr);
-        dc_regex_free(re);
-        return match_io_err(err.msg[0] ? err.msg : "read error");
+        rc = match_io_err(err.msg[0] ? err.msg : "read error");
+        goto done;
       }
       break; /* EOF */
     }
 
-    // Match against the line content excluding a terminating '\n' (if present),
-    // but always emit the original bytes verbatim when matched.
-    size_t subj_len = v.len;
-    if (v.ends_with_nl && subj_len > 0) subj_len--;
-
+    // Lines are matched without their terminating '\n' but emitted verbatim.
     bool exec_limit = false;
-    bool matched = dc_regex_match_line(re, v.ptr, subj_len, &exec_limit);
-    if (exec_limit) {
-      fprintf(stderr, "match: regex execution limit exceeded\n");
-      dc_lr_close(lr);
-      dc_regex_free(re);
-      return 2;
-    }
-
-    if (matched) {
-      if (v.len > 0) {
-        size_t n = fwrite(v.ptr, 1, v.len, stdout);
-        if (n != v.len || ferror(stdout)) {
-          dc_lr_close(lr);
-          dc_regex_free(re);
-          return match_io_err("write error");
-        }
-
-        // Force the kernel write while SIGPIPE is ignored, and verify stdio state.
-        if (fflush(stdout) != 0 || ferror(stdout)) {
-          dc_lr_close(lr);
-          dc_regex_free(re);
-          return match_io_err("write error");
-        }
-      }
-      emitted = true;
+    if (!dc_regex_scan_par(re, blk.ptr, blk.len, nthreads, match_emit, &sink, &exec_limit)) {
+      // NUL bytes from a truncated file can also run into a limit.
+      if (!dc_lr_intact(lr, &err)) rc = match_io_err(err.msg);
+      else if (exec_limit) rc = match_io_err("regex execution limit exceeded");
+      else rc = match_io_err(err.msg[0] ? err.msg : "write error");
+      goto done;
     }
   }
 
-  // Final safety check for any pending stdio error.
-  if (fflush(stdout) != 0 || ferror(stdout)) {
-    dc_lr_close(lr);
-    dc_regex_free(re);
-    return match_io_err("write error");
-  }
+  rc = sink.emitted ? 0 : 1;
 
+done:
+  if (!dc_out_close(out, &err) && rc != 2) {
+    rc = match_io_err(err.msg[0] ? err.msg : "write error");
+  }
   dc_lr_close(lr);
-  dc_regex_free(re);
-  return emitted ? 0 : 1;
+  match_release(re, cached);
+  return rc;
 }
 
 /*
 Parsing rules (same style as lines):
-- Only --help is recognized.
+- Only --help, --cache-stats, --cache-clear, -A NAME and --var NAME are
+  recognized.
 - Any other -x token is an error unless after --, or token is exactly '-'.
-- PATTERN is required and is the first non-option token.
+- PATTERN is required and is the first non-option token, unless -e
+  PATTERN or -f FILE is given (any number of times, before --); then every
+  non-option token is a FILE.
 */
 __attribute__((visibility("default")))
 int match_builtin(WORD_LIST *list) {
@@ -130,6 +230,11 @@ int match_builtin(WORD_LIST *list) {
 
   bool end_opts = false;
   const char *pattern = NULL;
+  const char *array_name = NULL;
+  const char *var_name = NULL;
+  dc_bi_input_t in = { .copy = NULL };
+  match_pats_t pats = { NULL, 0, 0, false };
+  bool have_set = false;
 
   size_t fcap = 8;
   size_t fcnt = 0;
@@ -145,8 +250,36 @@ int match_builtin(WORD_LIST *list) {
     const char *tok = w->word->word;
     if (!tok) tok = "";
 
-    if (!pattern) {
+    if (!end_opts) {
+      int a = dc_bi_io_opt(&w, &array_name, &var_name);
+      if (a < 0) {
+        rc = match_usage_err("missing NAME after -A / --var");
+        goto out;
+      }
+      if (a > 0) continue;
+
+      if (strcmp(tok, "-e") == 0 || strcmp(tok, "-f") == 0) {
+        if (!w->next || !w->next->word->word) {
+          rc = match_usage_err(tok[1] == 'e' ? "missing PATTERN after -e" : "missing FILE after -f");
+          goto out;
+        }
+        w = w->next;
+        const char *arg = w->word->word;
+        if (tok[1] == 'e') {
+          if ((rc = match_pats_add(&pats, arg, strlen(arg))) != 0) goto out;
+        } else if (match_pats_read(&pats, arg) != 0) {
+          rc = 2;
+          goto out;
+        }
+        have_set = true;
+        continue;
+      }
+    }
+
+    if (!pattern && !have_set) {
       if (!end_opts && strcmp(tok, "--help") == 0) { rc = match_help(); goto out; }
+      if (!end_opts && strcmp(tok, "--cache-stats") == 0) { rc = match_cache_stats(); goto out; }
+      if (!end_opts && strcmp(tok, "--cache-clear") == 0) { rc = match_cache_clear(); goto out; }
       if (!end_opts && strcmp(tok, "--") == 0) { end_opts = true; continue; }
 
       if (!end_opts && tok[0] == '-' && tok[1] != '\0' && strcmp(tok, "-") != 0) {
@@ -175,11 +308,35 @@ int match_builtin(WORD_LIST *list) {
     files[fcnt++] = (char *)tok;
   }
 
-  if (!pattern) { rc = match_usage_err("missing PATTERN"); goto out; }
-
-  rc = match_main(pattern, files, fcnt);
+  if (have_set && pattern) {
+    // Taken as PATTERN before a later -e / -f showed up: it is a FILE.
+    if (fcnt == fcap) {
+      char **nf = (char **)realloc(files, (fcap + 1) * sizeof(char *));
+      if (!nf) { rc = match_io_err("out of memory"); goto out; }
+      files = nf;
+      fcap++;
+    }
+    memmove(files + 1, files, fcnt * sizeof(char *));
+    files[0] = (char *)pattern;
+    fcnt++;
+  }
+  if (!pattern && !have_set) { rc = match_usage_err("missing PATTERN"); goto out; }
+
+  dc_bi_array_t arr;
+  if (!dc_bi_io_begin("match", array_name, var_name, fcnt, &arr, &in)) goto out;
+  if (have_set && pats.all) {
+    static const char *const match_all = "";
+    rc = match_main(&match_all, 1, files, fcnt, array_name ? &arr : NULL, var_name ? &in : NULL);
+  } else if (have_set) {
+    rc = match_main((const char *const *)pats.p, pats.n, files, fcnt, array_name ? &arr : NULL,
+                    var_name ? &in : NULL);
+  } else {
+    rc = match_main(&pattern, 1, files, fcnt, array_name ? &arr : NULL, var_name ? &in : NULL);
+  }
 
 out:
+  dc_bi_input_free(&in);
+  match_pats_free(&pats);
   free(files);
   signal(SIGPIPE, old_sigpipe);
   return rc;
@@ -191,6 +348,6 @@ struct builtin match_struct = {
   .function = match_builtin,
   .flags = BUILTIN_ENABLED,
   .long_doc = match_doc,
-  .short_doc = (char *)"match PATTERN [--] [FILE...]",
+  .short_doc = (char *)"match [-A NAME] [--var NAME] PATTERN | -e PATTERN... | -f FILE [--] [FILE...]",
   .handle = 0,
 };
\ No newline at end of file
@@ -14,9 +14,10 @@
 #include "config.h"
 #include "builtins.h"
 #include "shell.h"
+#include "dc_builtin.h"
 
 __attribute__((unused))
-static const char *trim_shortdoc = "trim [--] [FILE...]";
+static const char *trim_shortdoc = "trim [-A NAME] [--var NAME] [--] [FILE...]";
 
 static char *trim_doc[] = {
   "Remove leading and trailing ASCII whitespace from each input line.",
@@ -40,67 +41,111 @@ static int trim_help(void) {
   return 0;
 }
 
-static inline bool is_trim_ws(uint8_t c) {
-  // ASCII whitespace to trim (newline is structural and handled separately)
-  return (c == (uint8_t)' ' || c == (uint8_t)'\t' || c == (uint8_t)'\r' ||
-          c == (uint8_t)'\v' || c == (uint8_t)'\f');
-}
-
-static int trim_main(char *const *files, size_t file_count) {
+static int trim_main(char *const *files, size_t file_count, dc_bi_array_t *arr, const dc_bi_input_t *in) {
   dc_error_t err;
-  dc_line_reader_t *lr = dc_lr_open(files, file_count, &err);
+  dc_line_reader_t *lr = dc_bi_lr_open(in, files, file_count, &err);
   if (!lr) {
     return trim_io_err(err.msg[0] ? err.msg : "cannot open input");
   }
 
+  dc_out_t *out = dc_bi_out_open(arr, &err);
+  if (!out) {
+    dc_lr_close(lr);
+    return trim_io_err(err.msg[0] ? err.msg : "out of memory");
+  }
+
+  dc_lr_set_refill_hook(lr, dc_bi_flush_on_refill, out);
+
   bool emitted_any = false;
+  int rc = 0;
 
+  // Work on runs of complete lines. Lines that need no trimming are left
+  // in place and written together with their neighbours, so clean input
+  // goes out in large contiguous writes straight from the reader.
   for (;;) {
-    dc_line_view_t v;
-    bool ok = dc_lr_next(lr, &v, &err);
+    dc_line_view_t b;
+    bool ok = dc_lr_next_block(lr, &b, &err);
     if (!ok) {
       if (err.code != DC_ERR_NONE) {
-        dc_lr_close(lr);
-        return trim_io_err(err.msg[0] ? err.msg : "read error");
+        rc = trim_io_err(err.msg[0] ? err.msg : "read error");
+        goto done;
       }
       break; // EOF
     }
 
-    // Exclude trailing '\n' from trim region; newline is structural.
-    size_t content_len = v.len;
-    if (v.ends_with_nl && content_len > 0) content_len -= 1;
+    const uint8_t *p = b.ptr;
+    const uint8_t *end = b.ptr + b.len;
+    const uint8_t *run = p; // start of bytes that pass through unchanged
+    bool clean_run = true;  // recent lines were clean: look for a long run
+
+    while (p < end) {
+      if (clean_run) {
+        size_t n = dc_trimmed_lines_len(p, (size_t)(end - p));
+        p += n; // stays in the run
+        if (p == end) break;
+        clean_run = n > 0;
+      }
 
-    size_t start = 0;
-    while (start < content_len && is_trim_ws(v.ptr[start])) start++;
+      // Exclude trailing '\n' from trim region; newline is structural.
+      const uint8_t *nl = (const uint8_t *)memchr(p, '\n', (size_t)(end - p));
+      const uint8_t *content_end = nl ? nl : end;
+      const uint8_t *next = nl ? nl + 1 : end;
+      size_t content_len = (size_t)(content_end - p);
+      size_t start = 0;
+      size_t out_len = dc_trim_span(p, content_len, &start);
+
+      if (out_len > 0 && out_len == content_len) {
+        p = next; // already trimmed: stays in the run
+        clean_run = true;
+        continue;
+      }
 
-    size_t end = content_len;
-    while (end > start && is_trim_ws(v.ptr[end - 1])) end--;
+      if (p > run) {
+        if (!dc_out_write(out, run, (size_t)(p - run), &err)) {
+          rc = trim_io_err(err.msg[0] ? err.msg : "write error");
+          goto done;
+        }
+        emitted_any = true;
+      }
 
-    size_t out_len = end - start;
-    if (out_len == 0) continue; // emit nothing for this line
+      if (out_len > 0) { // otherwise emit nothing for this line
+        if (!dc_out_write(out, p + start, out_len, &err) ||
+            (nl && !dc_out_putc(out, (uint8_t)'\n', &err))) {
+          rc = trim_io_err(err.msg[0] ? err.msg : "write error");
+          goto done;
+        }
+        emitted_any = true;
+      }
+      p = run = next;
+    }
 
-    size_t n = fwrite(v.ptr + start, 1, out_len, stdout);
-    if (n != out_len) {
-      dc_lr_close(lr);
-      return trim_io_err("write error");
+    // A file truncated during the scan above reads as NUL bytes from there.
+    if (!dc_lr_intact(lr, &err)) {
+      rc = trim_io_err(err.msg);
+      goto done;
     }
 
-    if (v.ends_with_nl) {
-      if (fputc('\n', stdout) == EOF) {
-        dc_lr_close(lr);
-        return trim_io_err("write error");
+    if (end > run) {
+      if (!dc_out_write(out, run, (size_t)(end - run), &err)) {
+        rc = trim_io_err(err.msg[0] ? err.msg : "write error");
+        goto done;
       }
+      emitted_any = true;
     }
-
-    emitted_any = true;
   }
 
+  rc = emitted_any ? 0 : 1;
+
+done:
+  if (!dc_out_close(out, &err) && rc != 2) {
+    rc = trim_io_err(err.msg[0] ? err.msg : "write error");
+  }
   dc_lr_close(lr);
-  return emitted_any ? 0 : 1;
+  return rc;
 }
 
 // Parsing rules:
-// - Only --help is recognized.
+// - Only --help, -A NAME and --var NAME are recognized.
 // - Any other -x token is an error unless after --, or token is exactly '-'.
 __attribute__((visibility("default")))
 int trim_builtin(WORD_LIST *list) {
@@ -110,6 +155,9 @@ int trim_builtin(WORD_LIST *list) {
   // === ANCHOR:SIGPIPE-END ===
 
   bool end_opts = false;
+  const char *array_name = NULL;
+  const char *var_name = NULL;
+  dc_bi_input_t in = { .copy = NULL };
 
   size_t fcap = 8;
   size_t fcnt = 0;
@@ -125,6 +173,15 @@ int trim_builtin(WORD_LIST *list) {
     const char *tok = w->word->word;
     if (!tok) tok = "";
 
+    if (!end_opts) {
+      int a = dc_bi_io_opt(&w, &array_name, &var_name);
+      if (a < 0) {
+        rc = trim_usage_err("missing NAME after -A / --var");
+        goto out;
+      }
+      if (a > 0) continue;
+    }
+
     if (!end_opts && strcmp(tok, "--help") == 0) {
       rc = trim_help();
       goto out;
@@ -152,9 +209,12 @@ int trim_builtin(WORD_LIST *list) {
     files[fcnt++] = (char *)tok;
   }
 
-  rc = trim_main(files, fcnt);
+  dc_bi_array_t arr;
+  if (!dc_bi_io_begin("trim", array_name, var_name, fcnt, &arr, &in)) goto out;
+  rc = trim_main(files, fcnt, array_name ? &arr : NULL, var_name ? &in : NULL);
 
 out:
+  dc_bi_input_free(&in);
   free(files);
   signal(SIGPIPE, old_sigpipe);
   return rc;
@@ -166,6 +226,6 @@ struct builtin trim_struct = {
   .function = trim_builtin,
   .flags = BUILTIN_ENABLED,
   .long_doc = trim_doc,
-  .short_doc = (char *)"trim [--] [FILE...]",
+  .short_doc = (char *)"trim [-A NAME] [--var NAME] [--] [FILE...]",
   .handle = 0,
 };
@@ -0,0 +1,188 @@
+// dc_builtin.h - shell-side helpers shared by the builtins
+//
+// Include after the bash headers: unlike diamondcore, these talk to the
+// shell's variable API directly.
+
+#ifndef DC_BUILTIN_H
+#define DC_BUILTIN_H
+
+#include "diamondcore.h"
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "common.h"
+
+/* -A NAME: output lines become the elements of indexed array NAME, as
+ * with `mapfile -t NAME < <(builtin ...)`, but without the subshell and
+ * the pipe. */
+typedef struct {
+  SHELL_VAR *var;
+  arrayind_t next;
+} dc_bi_array_t;
+
+/* Recognize `-A NAME` at *W (an option position, before `--`). Returns 1
+ * and leaves *W on NAME when taken, 0 for any other token, -1 if NAME is
+ * missing. */
+static inline int dc_bi_array_opt(WORD_LIST **w, const char **name) {
+  if (strcmp((*w)->word->word ? (*w)->word->word : "", "-A") != 0) return 0;
+  if (!(*w)->next || !(*w)->next->word->word) return -1;
+  *w = (*w)->next;
+  *name = (*w)->word->word;
+  return 1;
+}
+
+/* Find or create NAME as an empty indexed array. On failure the shell has
+ * already reported why (invalid name, readonly, associative array). */
+static inline bool dc_bi_array_bind(dc_bi_array_t *arr, const char *name) {
+  arr->next = 0;
+  arr->var = builtin_find_indexed_array((char *)name, 3); // 1: empty it, 2: check NAME
+  return arr->var != NULL;
+}
+
+static inline bool dc_bi_array_line(void *arg, const uint8_t *line, size_t len, dc_error_t *err) {
+  (void)len; // elements end at the first NUL, as any shell string
+  dc_bi_array_t *arr = (dc_bi_array_t *)arg;
+  if (!bind_array_element(arr->var, arr->next, (char *)line, 0)) {
+    dc_err_set(err, DC_ERR_IO, "cannot assign array element");
+    return false;
+  }
+  arr->next++;
+  return true;
+}
+
+/* The builtin's output: stdout, or ARR when -A was given. */
+static inline dc_out_t *dc_bi_out_open(dc_bi_array_t *arr, dc_error_t *err) {
+  return arr ? dc_out_open_lines(dc_bi_array_line, arr, err) : dc_out_open(stdout, err);
+}
+
+/* Refill hook for the builtin's reader: output is batched, so flush it
+ * whenever the reader is about to wait for more input. EPIPE then shows up
+ * once per input block, and interactive streams (`tail -f log | trim`) are
+ * never held back behind a partly filled buffer. */
+static inline bool dc_bi_flush_on_refill(void *arg, dc_error_t *err) {
+  return dc_out_flush((dc_out_t *)arg, err);
+}
+
+/* --var NAME: read the value of shell variable NAME instead of FILEs, as
+ * `builtin <<< "$NAME"` would but with no here-string file or pipe and
+ * without the added '\n'. A string is read in place. The elements of an
+ * indexed array are lines: they are joined with '\n' into one copy. */
+typedef struct {
+  dc_field_view_t src;
+  uint8_t *copy; // owned; NULL when SRC points into the variable
+} dc_bi_input_t;
+
+/* Recognize `--var NAME` at *W; same contract as dc_bi_array_opt. */
+static inline int dc_bi_var_opt(WORD_LIST **w, const char **name) {
+  if (strcmp((*w)->word->word ? (*w)->word->word : "", "--var") != 0) return 0;
+  if (!(*w)->next || !(*w)->next->word->word) return -1;
+  *w = (*w)->next;
+  *name = (*w)->word->word;
+  return 1;
+}
+
+typedef struct {
+  size_t len;
+  uint8_t *dst; // NULL while measuring
+} dc_bi_join_t;
+
+static inline int dc_bi_join_elem(ARRAY_ELEMENT *ae, void *arg) {
+  dc_bi_join_t *j = (dc_bi_join_t *)arg;
+  const char *v = element_value(ae) ? element_value(ae) : "";
+  size_t n = strlen(v);
+  if (j->dst) {
+    memcpy(j->dst + j->len, v, n);
+    j->dst[j->len + n] = '\n';
+  }
+  j->len += n + 1;
+  return 0;
+}
+
+/* Look NAME up for --var. With COPY the input is never read in place,
+ * because the builtin's output (-A) may overwrite the variable. */
+static inline bool dc_bi_var_input(dc_bi_input_t *in, const char *name, bool copy, dc_error_t *err) {
+  dc_err_init(err);
+  memset(in, 0, sizeof(*in));
+  SHELL_VAR *v = find_variable(name);
+  if (!v) {
+    dc_err_set(err, DC_ERR_USAGE, "%s: no such variable", name);
+    return false;
+  }
+  if (assoc_p(v)) {
+    dc_err_set(err, DC_ERR_USAGE, "%s: not a string or indexed array", name);
+    return false;
+  }
+  if (invisible_p(v) || !value_cell(v)) return true; // declared, no value: empty input
+
+  if (!array_p(v)) {
+    const char *s = value_cell(v);
+    size_t n = strlen(s);
+    if (copy && n > 0) {
+      if (!(in->copy = (uint8_t *)malloc(n))) goto nomem;
+      memcpy(in->copy, s, n);
+      s = (const char *)in->copy;
+    }
+    in->src.ptr = (const uint8_t *)s;
+    in->src.len = n;
+    return true;
+  }
+
+  dc_bi_join_t j = { 0, NULL };
+  array_walk(array_cell(v), dc_bi_join_elem, &j);
+  if (j.len == 0) return true;
+  size_t total = j.len;
+  if (!(j.dst = (uint8_t *)malloc(total))) goto nomem;
+  j.len = 0;
+  array_walk(array_cell(v), dc_bi_join_elem, &j);
+  in->copy = j.dst;
+  in->src.ptr = j.dst;
+  in->src.len = total;
+  return true;
+
+nomem:
+  dc_err_set(err, DC_ERR_NOMEM, "out of memory");
+  return false;
+}
+
+static inline void dc_bi_input_free(dc_bi_input_t *in) {
+  if (in) free(in->copy);
+}
+
+/* The builtin's input: IN when --var was given, else FILES / stdin. */
+static inline dc_line_reader_t *dc_bi_lr_open(const dc_bi_input_t *in, char *const *files,
+                                              size_t file_count, dc_error_t *err) {
+  return in ? dc_lr_open_mem(&in->src, 1, err) : dc_lr_open(files, file_count, err);
+}
+
+/* -A NAME or --var NAME at *W: 1 when taken, 0 for any other token, -1
+ * if NAME is missing. */
+static inline int dc_bi_io_opt(WORD_LIST **w, const char **array_name, const char **var_name) {
+  int a = dc_bi_array_opt(w, array_name);
+  return a ? a : dc_bi_var_opt(w, var_name);
+}
+
+/* After option parsing: load --var input and bind the -A array, in that
+ * order so a copy is taken when both may name the same variable. Prints
+ * "WHO: message" (unless the shell already reported it) and returns false
+ * on error; IN must be freed with dc_bi_input_free either way. */
+static inline bool dc_bi_io_begin(const char *who, const char *array_name, const char *var_name,
+                                  size_t file_count, dc_bi_array_t *arr, dc_bi_input_t *in) {
+  memset(in, 0, sizeof(*in));
+  if (var_name) {
+    if (file_count > 0) {
+      fprintf(stderr, "%s: --var takes no FILE operands\n", who);
+      return false;
+    }
+    dc_error_t err;
+    if (!dc_bi_var_input(in, var_name, array_name != NULL, &err)) {
+      fprintf(stderr, "%s: %s\n", who, err.msg);
+      return false;
+    }
+  }
+  return !array_name || dc_bi_array_bind(arr, array_name);
+}
+
+#endif /* DC_BUILTIN_H */
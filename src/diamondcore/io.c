@@ -1,48 +1,174 @@
 // io.c - streaming line reader across stdin and/or files
 
 #include "diamondcore.h"
+#include "simd_int.h"
 
-#include <sys/types.h>  /* ssize_t */
-#include <stdio.h>      /* getline */
+#include <sys/mman.h>   /* madvise */
+#include <sys/stat.h>   /* fstat */
+#include <sys/types.h>  /* ssize_t, off_t */
 #include <errno.h>
+#include <fcntl.h>      /* open */
 #include <stdlib.h>
-#include <string.h>
+#include <string.h>     /* memchr, memrchr, memmove */
+#include <unistd.h>     /* read, close, lseek */
+
+/* Size of each read(2) into the block buffer. The buffer only grows past
+ * this when a single line does not fit. */
+#define DC_LR_BLOCK_SIZE ((size_t)128 * 1024)
 
 struct dc_line_reader {
   char **files;
   size_t file_count;
   size_t idx;
-  FILE *fp;
-  bool fp_is_stdin;
-  char *buf;
+  const dc_field_view_t *mem; /* in-memory sources instead of FILEs */
+  bool open;          /* a source is open */
+  int fd;             /* -1 unless the open source is a file */
+  bool fd_is_stdin;
+  bool eof;           /* no more bytes to read from the current source */
+  const uint8_t *data; /* buf, or the mapping of a regular file */
+  dc_map_t map;       /* map.ptr is non-NULL while a regular file is mapped */
+  uint8_t *buf;
   size_t buf_cap;
+  size_t head;        /* first byte of data not yet handed out */
+  size_t scan;        /* bytes in [head, scan) are known to hold no '\n' */
+  size_t tail;        /* one past the last valid byte */
+  dc_lr_refill_fn refill_hook;
+  void *refill_arg;
+  bool use_index;
+  dc_lineidx_t *index; /* sidecar index of the current file, if valid */
+  uint64_t src_line;  /* lines handed out of the current source; UINT64_MAX if unknown */
 };
 
+static void close_current(dc_line_reader_t *lr) {
+  dc_lineidx_free(lr->index);
+  lr->index = NULL;
+  lr->src_line = 0;
+  dc_map_close(&lr->map);
+  if (lr->fd >= 0) {
+    if (lr->fd_is_stdin) {
+      // Hand unconsumed bytes back to a seekable stdin so the next reader
+      // (another builtin in the same shell) resumes at the right line.
+      if (!lr->eof && lr->tail > lr->head) {
+        (void)lseek(lr->fd, -(off_t)(lr->tail - lr->head), SEEK_CUR);
+      }
+    } else {
+      close(lr->fd);
+    }
+  }
+  lr->open = false;
+  lr->fd = -1;
+  lr->fd_is_stdin = false;
+  lr->eof = false;
+  lr->data = lr->buf;
+  lr->head = lr->scan = lr->tail = 0;
+}
+
+/* Map a non-empty regular file so lines are handed out as slices of the
+ * page cache. On any failure the caller keeps using read(2). */
+static void try_map(dc_line_reader_t *lr) {
+  struct stat st;
+  if (fstat(lr->fd, &st) != 0 || !S_ISREG(st.st_mode) || st.st_size <= 0) return;
+  if ((uintmax_t)st.st_size > (uintmax_t)SIZE_MAX) return;
+
+  size_t len = (size_t)st.st_size;
+  if (!dc_map_open(&lr->map, lr->fd, len)) return;
+
+  // Advisory only; errors are ignored.
+  (void)madvise((void *)lr->map.ptr, len, MADV_SEQUENTIAL);
+#ifdef MADV_HUGEPAGE
+  (void)madvise((void *)lr->map.ptr, len, MADV_HUGEPAGE);
+#endif
+
+  lr->data = lr->map.ptr;
+  lr->tail = len;
+  lr->eof = true; // the whole source is already "read"
+}
+
+/* A mapped file that shrank while being read has NUL bytes in place of
+ * what was cut off; report that rather than hand them out as lines. */
+static bool map_intact(const dc_line_reader_t *lr, dc_error_t *err) {
+  if (!dc_map_truncated(&lr->map)) return true;
+  dc_err_set(err, DC_ERR_IO, "read error: '%s' shrank while being read", lr->files[lr->idx - 1]);
+  return false;
+}
+
 static bool open_next(dc_line_reader_t *lr, dc_error_t *err) {
   if (!lr) return false;
-  if (lr->fp && !lr->fp_is_stdin) {
-    fclose(lr->fp);
-  }
-  lr->fp = NULL;
-  lr->fp_is_stdin = false;
+  close_current(lr);
 
   if (lr->idx >= lr->file_count) return false;
 
+  if (lr->mem) {
+    // Like a mapped file that is already read in full.
+    const dc_field_view_t *m = &lr->mem[lr->idx++];
+    lr->data = m->ptr;
+    lr->tail = m->len;
+    lr->eof = true;
+    lr->open = true;
+    return true;
+  }
+
   const char *name = lr->files[lr->idx++];
   if (strcmp(name, "-") == 0) {
-    lr->fp = stdin;
-    lr->fp_is_stdin = true;
+    lr->fd = STDIN_FILENO;
+    lr->fd_is_stdin = true;
+    lr->open = true;
     return true;
   }
 
-  lr->fp = fopen(name, "rb");
-  if (!lr->fp) {
+  lr->fd = open(name, O_RDONLY | O_CLOEXEC);
+  if (lr->fd < 0) {
     dc_err_set(err, DC_ERR_IO, "cannot open '%s': %s", name, strerror(errno));
     return false;
   }
+  lr->open = true;
+  try_map(lr);
+  if (lr->use_index) lr->index = dc_lineidx_load(name, lr->fd);
   return true;
 }
 
+/* Make room and read(2) the next block. Partial-line bytes are slid to the
+ * front of the buffer; the buffer doubles only when a line fills it. */
+static bool fill(dc_line_reader_t *lr, dc_error_t *err) {
+  if (lr->head > 0) {
+    size_t keep = lr->tail - lr->head;
+    if (keep > 0) memmove(lr->buf, lr->buf + lr->head, keep);
+    lr->scan -= lr->head;
+    lr->tail = keep;
+    lr->head = 0;
+  }
+
+  if (lr->buf_cap - lr->tail < DC_LR_BLOCK_SIZE / 2) {
+    size_t ncap = lr->buf_cap ? lr->buf_cap * 2 : DC_LR_BLOCK_SIZE;
+    uint8_t *nb = (uint8_t *)realloc(lr->buf, ncap);
+    if (!nb) {
+      dc_err_set(err, DC_ERR_NOMEM, "out of memory");
+      return false;
+    }
+    lr->buf = nb;
+    lr->buf_cap = ncap;
+    lr->data = nb;
+  }
+
+  // read(2) may block from here on; let the caller publish pending work.
+  if (lr->refill_hook && !lr->refill_hook(lr->refill_arg, err)) return false;
+
+  for (;;) {
+    ssize_t n = read(lr->fd, lr->buf + lr->tail, lr->buf_cap - lr->tail);
+    if (n > 0) {
+      lr->tail += (size_t)n;
+      return true;
+    }
+    if (n == 0) {
+      lr->eof = true;
+      return true;
+    }
+    if (errno == EINTR) continue;
+    dc_err_set(err, DC_ERR_IO, "read error: %s", strerror(errno));
+    return false;
+  }
+}
+
 dc_line_reader_t *dc_lr_open(char *const *files, size_t file_count, dc_error_t *err) {
   dc_err_init(err);
   dc_line_reader_t *lr = (dc_line_reader_t *)calloc(1, sizeof(dc_line_reader_t));
@@ -73,7 +199,7 @@ dc_line_reader_t *dc_lr_open(char *const *files, size_t file_count, dc_error_t *
   }
 
   lr->idx = 0;
-  lr->fp = NULL;
+  lr->fd = -1;
   lr->buf = NULL;
   lr->buf_cap = 0;
 
@@ -81,6 +207,25 @@ dc_line_reader_t *dc_lr_open(char *const *files, size_t file_count, dc_error_t *
   return lr;
 }
 
+dc_line_reader_t *dc_lr_open_mem(const dc_field_view_t *srcs, size_t n, dc_error_t *err) {
+  dc_err_init(err);
+  dc_line_reader_t *lr = (dc_line_reader_t *)calloc(1, sizeof(dc_line_reader_t));
+  if (!lr) {
+    dc_err_set(err, DC_ERR_NOMEM, "out of memory");
+    return NULL;
+  }
+  lr->mem = srcs;
+  lr->file_count = n;
+  lr->fd = -1;
+  return lr;
+}
+
+void dc_lr_set_refill_hook(dc_line_reader_t *lr, dc_lr_refill_fn fn, void *arg) {
+  if (!lr) return;
+  lr->refill_hook = fn;
+  lr->refill_arg = arg;
+}
+
 bool dc_lr_next(dc_line_reader_t *lr, dc_line_view_t *out, dc_error_t *err) {
   dc_err_init(err);
   if (!lr || !out) {
@@ -89,40 +234,330 @@ bool dc_lr_next(dc_line_reader_t *lr, dc_line_view_t *out, dc_error_t *err) {
   }
 
   for (;;) {
-    if (!lr->fp) {
+    if (!lr->open) {
       if (!open_next(lr, err)) {
         // If open_next fails with err set => error; otherwise EOF.
         return false;
       }
     }
 
-    errno = 0;
-    ssize_t n = getline(&lr->buf, &lr->buf_cap, lr->fp);
-    if (n >= 0) {
-      out->ptr = (const uint8_t *)lr->buf;
-      out->len = (size_t)n;
-      out->ends_with_nl = (n > 0 && lr->buf[n - 1] == '\n');
-      return true;
+    if (lr->scan < lr->tail) {
+      const uint8_t *nl = (const uint8_t *)memchr(lr->data + lr->scan, '\n', lr->tail - lr->scan);
+      if (!map_intact(lr, err)) return false;
+      if (nl) {
+        size_t end = (size_t)(nl - lr->data) + 1;
+        out->ptr = lr->data + lr->head;
+        out->len = end - lr->head;
+        out->ends_with_nl = true;
+        lr->head = lr->scan = end;
+        if (lr->src_line != UINT64_MAX) lr->src_line++;
+        return true;
+      }
+      lr->scan = lr->tail;
     }
 
-    // n < 0
-    if (feof(lr->fp)) {
+    if (lr->eof) {
+      if (!map_intact(lr, err)) return false;
+      if (lr->head < lr->tail) {
+        // Unterminated final line of this source.
+        out->ptr = lr->data + lr->head;
+        out->len = lr->tail - lr->head;
+        out->ends_with_nl = false;
+        lr->head = lr->scan = lr->tail;
+        if (lr->src_line != UINT64_MAX) lr->src_line++;
+        return true;
+      }
       // Move to next source.
-      if (lr->fp && !lr->fp_is_stdin) fclose(lr->fp);
-      lr->fp = NULL;
-      lr->fp_is_stdin = false;
+      close_current(lr);
       continue;
     }
 
-    // Error
-    dc_err_set(err, DC_ERR_IO, "read error: %s", strerror(errno ? errno : EIO));
+    if (!fill(lr, err)) return false;
+  }
+}
+
+bool dc_lr_next_block(dc_line_reader_t *lr, dc_line_view_t *out, dc_error_t *err) {
+  dc_err_init(err);
+  if (!lr || !out) {
+    dc_err_set(err, DC_ERR_INTERNAL, "internal: null reader/out");
     return false;
   }
+
+  for (;;) {
+    if (!lr->open) {
+      if (!open_next(lr, err)) return false;
+    }
+
+    if (lr->scan < lr->tail) {
+      // [head, scan) holds no '\n', so the last one in [scan, tail) ends
+      // the run of complete lines.
+      const uint8_t *nl = (const uint8_t *)memrchr(lr->data + lr->scan, '\n', lr->tail - lr->scan);
+      if (!map_intact(lr, err)) return false;
+      if (nl) {
+        size_t end = (size_t)(nl - lr->data) + 1;
+        out->ptr = lr->data + lr->head;
+        out->len = end - lr->head;
+        out->ends_with_nl = true;
+        lr->head = lr->scan = end;
+        lr->src_line = UINT64_MAX; // lines are not counted in block mode
+        return true;
+      }
+      lr->scan = lr->tail;
+    }
+
+    if (lr->eof) {
+      // Also catches faults in the caller's reads of the previous block.
+      if (!map_intact(lr, err)) return false;
+      if (lr->head < lr->tail) {
+        out->ptr = lr->data + lr->head;
+        out->len = lr->tail - lr->head;
+        out->ends_with_nl = false;
+        lr->head = lr->scan = lr->tail;
+        lr->src_line = UINT64_MAX;
+        return true;
+      }
+      close_current(lr);
+      continue;
+    }
+
+    if (!fill(lr, err)) return false;
+  }
+}
+
+bool dc_lr_intact(const dc_line_reader_t *lr, dc_error_t *err) {
+  return !lr || map_intact(lr, err);
+}
+
+void dc_lr_use_index(dc_line_reader_t *lr, bool on) {
+  if (lr) lr->use_index = on;
+}
+
+/* Use the sidecar index to skip towards LEFT more lines of the current
+ * file; returns how many lines were jumped over. */
+static uint64_t index_jump(dc_line_reader_t *lr, uint64_t left) {
+  if (!lr->index || lr->src_line == UINT64_MAX) return 0;
+
+  uint64_t total = dc_lineidx_lines(lr->index);
+  if (lr->src_line >= total) return 0; // at EOF; the caller moves on
+  if (lr->src_line + left >= total) {
+    // Everything that is left of this file.
+    uint64_t n = total - lr->src_line;
+    close_current(lr);
+    return n;
+  }
+
+  uint64_t at = 0, off = 0;
+  if (!dc_lineidx_seek(lr->index, lr->src_line + left, &at, &off) || at <= lr->src_line) return 0;
+  if (lr->map.ptr) {
+    if (off > lr->map.len) return 0;
+    lr->head = lr->scan = (size_t)off;
+  } else {
+    if (lseek(lr->fd, (off_t)off, SEEK_SET) < 0) return 0;
+    lr->head = lr->scan = lr->tail = 0;
+    lr->eof = false;
+  }
+  uint64_t n = at - lr->src_line;
+  lr->src_line = at;
+  return n;
+}
+
+/* Consume up to WANT newline-terminated lines from P[0..len) by counting
+ * '\n' 64 bytes at a time. Returns the number of lines consumed and sets
+ * *USED to the bytes they span. */
+static uint64_t count_lines(const uint8_t *p, size_t len, uint64_t want, size_t *used) {
+  bool avx2 = dc_simd_avx2();
+  uint64_t got = 0;
+  size_t i = 0;
+  *used = 0;
+
+  for (; i + 64 <= len; i += 64) {
+    uint64_t m = dc_eq_mask64(p + i, '\n', avx2);
+    if (!m) continue;
+    uint64_t c = (uint64_t)__builtin_popcountll(m);
+    if (got + c < want) {
+      got += c;
+      *used = i + 64 - (size_t)__builtin_clzll(m);
+      continue;
+    }
+    // The target newline is in this block: drop the set bits before it.
+    for (uint64_t k = want - got; k > 1; k--) m &= m - 1;
+    *used = i + (size_t)__builtin_ctzll(m) + 1;
+    return want;
+  }
+
+  while (got < want && i < len) {
+    const uint8_t *nl = (const uint8_t *)memchr(p + i, '\n', len - i);
+    if (!nl) break;
+    i = (size_t)(nl - p) + 1;
+    *used = i;
+    got++;
+  }
+  return got;
+}
+
+bool dc_lr_skip(dc_line_reader_t *lr, uint64_t n, uint64_t *skipped, dc_error_t *err) {
+  dc_err_init(err);
+  uint64_t done = 0;
+  if (skipped) *skipped = 0;
+  if (!lr) {
+    dc_err_set(err, DC_ERR_INTERNAL, "internal: null reader");
+    return false;
+  }
+
+  // Skipped bytes are never handed out, so a partial line need not be
+  // kept in the buffer; PARTIAL remembers that one was dropped.
+  bool partial = false;
+
+  while (done < n) {
+    if (!lr->open) {
+      partial = false;
+      if (!open_next(lr, err)) break;
+    }
+    uint64_t j = index_jump(lr, n - done);
+    if (j > 0) {
+      partial = false;
+      done += j;
+      continue;
+    }
+
+    if (lr->head < lr->tail) {
+      size_t used = 0;
+      uint64_t got = count_lines(lr->data + lr->head, lr->tail - lr->head, n - done, &used);
+      if (!map_intact(lr, err)) break;
+      if (got > 0) {
+        partial = false;
+        lr->head += used;
+        if (lr->scan < lr->head) lr->scan = lr->head;
+        if (lr->src_line != UINT64_MAX) lr->src_line += got;
+        done += got;
+        continue;
+      }
+      // No '\n' left in the buffer: the rest belongs to a skipped line.
+      partial = true;
+      lr->head = lr->scan = lr->tail;
+    }
+
+    if (lr->eof) {
+      if (!map_intact(lr, err)) break;
+      if (partial) {
+        // Unterminated final line of this source.
+        partial = false;
+        if (lr->src_line != UINT64_MAX) lr->src_line++;
+        done++;
+      }
+      close_current(lr);
+      continue;
+    }
+
+    if (!fill(lr, err)) break;
+  }
+
+  if (skipped) *skipped = done;
+  return err ? err->code == DC_ERR_NONE : true;
+}
+
+bool dc_lr_inputs_regular(const dc_line_reader_t *lr) {
+  if (!lr || lr->mem) return false;
+  for (size_t i = 0; i < lr->file_count; i++) {
+    struct stat st;
+    if (strcmp(lr->files[i], "-") == 0) return false;
+    if (stat(lr->files[i], &st) != 0 || !S_ISREG(st.st_mode)) return false;
+  }
+  return true;
+}
+
+/* Walk FD (SIZE bytes) backward a block at a time, counting line starts
+ * until *NEED reaches 0. Sets *AT to the offset of the line that did it. */
+static bool tail_scan(dc_line_reader_t *lr, int fd, uint64_t size, uint64_t *need,
+                      uint64_t *found, uint64_t *at, dc_error_t *err) {
+  // A '\n' starts a line only if a byte follows it.
+  uint64_t end = size > 0 ? size - 1 : 0;
+  while (end > 0 && *need > 0) {
+    size_t blk = end < DC_LR_BLOCK_SIZE ? (size_t)end : DC_LR_BLOCK_SIZE;
+    uint64_t base = end - blk;
+    size_t got = 0;
+    while (got < blk) {
+      ssize_t r = pread(fd, lr->buf + got, blk - got, (off_t)(base + got));
+      if (r < 0 && errno == EINTR) continue;
+      if (r <= 0) {
+        dc_err_set(err, DC_ERR_IO, "read error: %s", r < 0 ? strerror(errno) : "file shrank");
+        return false;
+      }
+      got += (size_t)r;
+    }
+
+    size_t lim = blk;
+    const uint8_t *nl;
+    while (*need > 0 && (nl = (const uint8_t *)memrchr(lr->buf, '\n', lim)) != NULL) {
+      lim = (size_t)(nl - lr->buf);
+      (*need)--;
+      (*found)++;
+      *at = base + lim + 1;
+    }
+    end = base;
+  }
+  if (*need > 0 && size > 0) {
+    // The first line of the file.
+    (*need)--;
+    (*found)++;
+    *at = 0;
+  }
+  return true;
+}
+
+bool dc_lr_seek_tail(dc_line_reader_t *lr, uint64_t n, uint64_t *found, dc_error_t *err) {
+  dc_err_init(err);
+  if (found) *found = 0;
+  if (!lr || !found || lr->idx != 0 || lr->open || lr->mem) {
+    dc_err_set(err, DC_ERR_INTERNAL, "internal: tail seek on a used reader");
+    return false;
+  }
+  if (lr->buf_cap < DC_LR_BLOCK_SIZE) {
+    uint8_t *nb = (uint8_t *)realloc(lr->buf, DC_LR_BLOCK_SIZE);
+    if (!nb) {
+      dc_err_set(err, DC_ERR_NOMEM, "out of memory");
+      return false;
+    }
+    lr->buf = nb;
+    lr->buf_cap = DC_LR_BLOCK_SIZE;
+    lr->data = nb;
+  }
+
+  uint64_t need = n, at = 0;
+  size_t f = lr->file_count;
+  while (f > 0 && need > 0) {
+    const char *name = lr->files[--f];
+    int fd = open(name, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+      dc_err_set(err, DC_ERR_IO, "cannot open '%s': %s", name, strerror(errno));
+      return false;
+    }
+    struct stat st;
+    bool ok = fstat(fd, &st) == 0;
+    if (!ok) dc_err_set(err, DC_ERR_IO, "cannot stat '%s': %s", name, strerror(errno));
+    else ok = tail_scan(lr, fd, (uint64_t)st.st_size, &need, found, &at, err);
+    close(fd);
+    if (!ok) return false;
+  }
+  if (need > 0) return true; // fewer than N lines: read from the start
+
+  // Reopen file F through the normal path and start at AT.
+  lr->idx = f;
+  if (!open_next(lr, err)) return false;
+  if (lr->map.ptr) {
+    if (at > lr->map.len) at = lr->map.len;
+    lr->head = lr->scan = (size_t)at;
+  } else if (lseek(lr->fd, (off_t)at, SEEK_SET) < 0) {
+    dc_err_set(err, DC_ERR_IO, "cannot seek '%s': %s", lr->files[f], strerror(errno));
+    return false;
+  }
+  lr->src_line = UINT64_MAX;
+  return true;
 }
 
 void dc_lr_close(dc_line_reader_t *lr) {
   if (!lr) return;
-  if (lr->fp && !lr->fp_is_stdin) fclose(lr->fp);
+  close_current(lr);
   free(lr->files);
   free(lr->buf);
   free(lr);
@@ -0,0 +1,249 @@
+// lineidx.c - sidecar line-offset index (FILE.dcidx)
+//
+// Layout (host byte order; the index is a local cache, not an interchange
+// format):
+//
+//   char     magic[8]      "DCIDX1\0\0"
+//   uint64_t dev, ino      identity of the indexed file
+//   uint64_t size
+//   int64_t  mtime_sec
+//   int64_t  mtime_nsec
+//   uint64_t stride        lines between samples
+//   uint64_t nlines        total lines (an unterminated last line counts)
+//   uint64_t count         number of samples
+//   uint64_t offs[count]   offs[k] = byte offset of line k*stride (0-based)
+//
+// An index whose identity fields do not match fstat() of the open file is
+// stale and ignored.
+
+#include "diamondcore.h"
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#define DC_IDX_MAGIC  "DCIDX1\0\0"
+#define DC_IDX_STRIDE 1024u
+#define DC_IDX_SUFFIX ".dcidx"
+
+typedef struct {
+  char magic[8];
+  uint64_t dev;
+  uint64_t ino;
+  uint64_t size;
+  int64_t mtime_sec;
+  int64_t mtime_nsec;
+  uint64_t stride;
+  uint64_t nlines;
+  uint64_t count;
+} idx_header_t;
+
+struct dc_lineidx {
+  uint64_t stride;
+  uint64_t nlines;
+  uint64_t count;
+  uint64_t *offs;
+};
+
+static void header_from_stat(idx_header_t *h, const struct stat *st) {
+  memset(h, 0, sizeof(*h));
+  memcpy(h->magic, DC_IDX_MAGIC, sizeof(h->magic));
+  h->dev = (uint64_t)st->st_dev;
+  h->ino = (uint64_t)st->st_ino;
+  h->size = (uint64_t)st->st_size;
+  h->mtime_sec = (int64_t)st->st_mtim.tv_sec;
+  h->mtime_nsec = (int64_t)st->st_mtim.tv_nsec;
+}
+
+static char *index_path(const char *path) {
+  size_t n = strlen(path);
+  char *p = (char *)malloc(n + sizeof(DC_IDX_SUFFIX));
+  if (!p) return NULL;
+  memcpy(p, path, n);
+  memcpy(p + n, DC_IDX_SUFFIX, sizeof(DC_IDX_SUFFIX));
+  return p;
+}
+
+static bool write_all(int fd, const void *p, size_t n) {
+  const uint8_t *b = (const uint8_t *)p;
+  while (n > 0) {
+    ssize_t w = write(fd, b, n);
+    if (w < 0) {
+      if (errno == EINTR) continue;
+      return false;
+    }
+    b += w;
+    n -= (size_t)w;
+  }
+  return true;
+}
+
+/* Append offset OFF to the growing sample array. */
+static bool push_off(uint64_t **offs, uint64_t *count, uint64_t *cap, uint64_t off) {
+  if (*count == *cap) {
+    uint64_t ncap = *cap ? *cap * 2 : 1024;
+    uint64_t *n = (uint64_t *)realloc(*offs, (size_t)ncap * sizeof(uint64_t));
+    if (!n) return false;
+    *offs = n;
+    *cap = ncap;
+  }
+  (*offs)[(*count)++] = off;
+  return true;
+}
+
+bool dc_lineidx_build(const char *path, dc_error_t *err) {
+  dc_err_init(err);
+
+  int fd = open(path, O_RDONLY | O_CLOEXEC);
+  if (fd < 0) {
+    dc_err_set(err, DC_ERR_IO, "cannot open '%s': %s", path, strerror(errno));
+    return false;
+  }
+
+  struct stat st;
+  if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode)) {
+    dc_err_set(err, DC_ERR_IO, "cannot index '%s': not a regular file", path);
+    close(fd);
+    return false;
+  }
+
+  idx_header_t h;
+  header_from_stat(&h, &st);
+  h.stride = DC_IDX_STRIDE;
+
+  uint64_t *offs = NULL, cap = 0;
+  bool ok = true;
+  size_t len = (size_t)st.st_size;
+  dc_map_t map = { NULL, 0, -1 };
+  if (len > 0) {
+    if (!dc_map_open(&map, fd, len)) {
+      dc_err_set(err, DC_ERR_IO, "cannot map '%s': %s", path, strerror(errno));
+      close(fd);
+      return false;
+    }
+    (void)madvise((void *)map.ptr, len, MADV_SEQUENTIAL);
+  }
+  const uint8_t *m = map.ptr;
+
+  // Walk the lines, sampling the start of every STRIDE-th one.
+  size_t pos = 0;
+  while (pos < len) {
+    if (h.nlines % DC_IDX_STRIDE == 0 && !push_off(&offs, &h.count, &cap, pos)) {
+      ok = false;
+      break;
+    }
+    h.nlines++;
+    const uint8_t *nl = (const uint8_t *)memchr(m + pos, '\n', len - pos);
+    pos = nl ? (size_t)(nl - m) + 1 : len;
+  }
+  bool shrank = dc_map_truncated(&map);
+  dc_map_close(&map);
+  close(fd);
+  if (!ok || shrank) {
+    free(offs);
+    if (shrank) dc_err_set(err, DC_ERR_IO, "cannot index '%s': file shrank while being read", path);
+    else dc_err_set(err, DC_ERR_NOMEM, "out of memory");
+    return false;
+  }
+
+  // Write to a temporary name and rename, so readers never see a torn file.
+  char *ipath = index_path(path);
+  size_t tlen = ipath ? strlen(ipath) + 32 : 0;
+  char *tmp = ipath ? (char *)malloc(tlen) : NULL;
+  if (!tmp) {
+    free(ipath);
+    free(offs);
+    dc_err_set(err, DC_ERR_NOMEM, "out of memory");
+    return false;
+  }
+  snprintf(tmp, tlen, "%s.tmp.%ld", ipath, (long)getpid());
+
+  int ifd = open(tmp, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+  if (ifd < 0) {
+    dc_err_set(err, DC_ERR_IO, "cannot create '%s': %s", ipath, strerror(errno));
+    ok = false;
+  } else {
+    ok = write_all(ifd, &h, sizeof(h)) &&
+         write_all(ifd, offs, (size_t)h.count * sizeof(uint64_t));
+    if (close(ifd) != 0) ok = false;
+    if (ok && rename(tmp, ipath) != 0) ok = false;
+    if (!ok) {
+      dc_err_set(err, DC_ERR_IO, "cannot write '%s': %s", ipath, strerror(errno));
+      (void)unlink(tmp);
+    }
+  }
+
+  free(tmp);
+  free(ipath);
+  free(offs);
+  return ok;
+}
+
+dc_lineidx_t *dc_lineidx_load(const char *path, int fd) {
+  struct stat st;
+  if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode)) return NULL;
+
+  char *ipath = index_path(path);
+  if (!ipath) return NULL;
+  int ifd = open(ipath, O_RDONLY | O_CLOEXEC);
+  free(ipath);
+  if (ifd < 0) return NULL;
+
+  dc_lineidx_t *idx = NULL;
+  idx_header_t want, h;
+  header_from_stat(&want, &st);
+
+  struct stat ist;
+  if (fstat(ifd, &ist) != 0 || pread(ifd, &h, sizeof(h), 0) != (ssize_t)sizeof(h)) goto out;
+  if (memcmp(h.magic, want.magic, sizeof(h.magic)) != 0 ||
+      h.dev != want.dev || h.ino != want.ino || h.size != want.size ||
+      h.mtime_sec != want.mtime_sec || h.mtime_nsec != want.mtime_nsec) {
+    goto out; // stale or foreign
+  }
+  if (h.stride == 0 || h.count != (h.nlines + h.stride - 1) / h.stride ||
+      (uint64_t)ist.st_size != sizeof(h) + h.count * sizeof(uint64_t)) {
+    goto out; // malformed
+  }
+
+  idx = (dc_lineidx_t *)calloc(1, sizeof(*idx));
+  if (!idx) goto out;
+  idx->stride = h.stride;
+  idx->nlines = h.nlines;
+  idx->count = h.count;
+  if (h.count > 0) {
+    size_t bytes = (size_t)h.count * sizeof(uint64_t);
+    idx->offs = (uint64_t *)malloc(bytes);
+    if (!idx->offs || pread(ifd, idx->offs, bytes, sizeof(h)) != (ssize_t)bytes) {
+      dc_lineidx_free(idx);
+      idx = NULL;
+    }
+  }
+
+out:
+  close(ifd);
+  return idx;
+}
+
+uint64_t dc_lineidx_lines(const dc_lineidx_t *idx) {
+  return idx ? idx->nlines : 0;
+}
+
+bool dc_lineidx_seek(const dc_lineidx_t *idx, uint64_t line, uint64_t *line_at, uint64_t *off) {
+  if (!idx || idx->count == 0 || line >= idx->nlines) return false;
+  uint64_t k = line / idx->stride;
+  *line_at = k * idx->stride;
+  *off = idx->offs[k];
+  return true;
+}
+
+void dc_lineidx_free(dc_lineidx_t *idx) {
+  if (!idx) return;
+  free(idx->offs);
+  free(idx);
+}
@@ -0,0 +1,171 @@
+// map.c - read-only file mappings that survive truncation
+//
+// Reading a page of a mapped file that lies wholly past the file's current
+// end raises SIGBUS, so a file truncated while we scan it (logrotate's
+// copytruncate) would kill the shell the builtin runs in. While any
+// mapping made here exists, a SIGBUS handler is installed. A fault inside
+// one of them maps zero pages over the rest of that mapping and marks it
+// truncated: the faulting read carries on, in whichever thread it
+// happened, and the owner reports the truncation as an I/O error. Any
+// other SIGBUS is passed on to the action that was installed before; ours
+// stays in place until the last mapping is closed.
+
+#include "diamondcore.h"
+
+#include <errno.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdatomic.h>
+#include <string.h>     /* memset */
+#include <sys/mman.h>
+#include <unistd.h>
+
+#define DC_MAP_SLOTS 64
+
+/* BASE is 0 while a slot is free and 1 while it is claimed but not (or no
+ * longer) mapped; the handler only looks at slots with a real address. */
+typedef struct {
+  _Atomic uintptr_t base;
+  size_t len;
+  volatile sig_atomic_t truncated;
+} map_slot_t;
+
+static map_slot_t map_slots[DC_MAP_SLOTS];
+static atomic_int map_live; /* slots in use; the handler is installed while > 0 */
+static pthread_mutex_t map_guard_lock = PTHREAD_MUTEX_INITIALIZER;
+static struct sigaction map_old_bus;
+static uintptr_t map_page_mask;
+
+// Hand a SIGBUS that is not ours to the previous action. A handler is
+// called directly. The default action ends the process, so only then is
+// that action restored: a fault is retried under it on return, a sent
+// signal is raised again and delivered once we return.
+static void map_chain(int sig, siginfo_t *si, void *uctx) {
+  if (map_old_bus.sa_flags & SA_SIGINFO) {
+    map_old_bus.sa_sigaction(sig, si, uctx);
+    return;
+  }
+  void (*h)(int) = map_old_bus.sa_handler;
+  bool sent = si->si_code <= 0; // kill(2) and friends, not a fault
+  if (h != SIG_DFL && h != SIG_IGN) {
+    h(sig);
+    return;
+  }
+  if (h == SIG_IGN && sent) return;
+  // SIG_DFL, or a fault under SIG_IGN, which the kernel does not let pass.
+  struct sigaction dfl;
+  memset(&dfl, 0, sizeof dfl);
+  dfl.sa_handler = SIG_DFL;
+  sigemptyset(&dfl.sa_mask);
+  sigaction(sig, &dfl, NULL);
+  if (sent) raise(sig);
+}
+
+static void map_on_sigbus(int sig, siginfo_t *si, void *uctx) {
+  (void)uctx;
+  uintptr_t a = (uintptr_t)si->si_addr;
+  for (size_t i = 0; i < DC_MAP_SLOTS; i++) {
+    map_slot_t *s = &map_slots[i];
+    uintptr_t b = atomic_load(&s->base);
+    if (b <= 1 || a < b || a - b >= s->len) continue;
+
+    // Zero pages from the faulting one to the end, so the rest of the
+    // mapping reads as NUL bytes instead of faulting page by page.
+    // mmap is not on POSIX's async-signal-safe list, but on Linux it is a
+    // bare system call: glibc takes no lock and allocates nothing, so it
+    // cannot deadlock on state the interrupted code holds. MAP_FIXED only
+    // replaces pages of this mapping, which the thread that faulted is
+    // reading and nothing else will touch until dc_map_close.
+    int saved = errno;
+    uintptr_t from = a & map_page_mask;
+    void *z = mmap((void *)from, b + s->len - from, PROT_READ,
+                   MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED, -1, 0);
+    errno = saved;
+    if (z == MAP_FAILED) break;
+    s->truncated = 1;
+    return;
+  }
+  // Not ours, or it cannot be patched.
+  map_chain(sig, si, uctx);
+}
+
+// The handler is installed and restored under MAP_GUARD_LOCK so that a
+// mapping is never created before it is guarded, whichever thread opens it.
+static bool map_guard_acquire(void) {
+  pthread_mutex_lock(&map_guard_lock);
+  bool ok = true;
+  if (atomic_load(&map_live) == 0) {
+    map_page_mask = ~((uintptr_t)sysconf(_SC_PAGESIZE) - 1);
+    struct sigaction sa;
+    memset(&sa, 0, sizeof sa);
+    sa.sa_sigaction = map_on_sigbus;
+    sa.sa_flags = SA_SIGINFO;
+    sigemptyset(&sa.sa_mask);
+    ok = sigaction(SIGBUS, &sa, &map_old_bus) == 0;
+  }
+  if (ok) atomic_fetch_add(&map_live, 1);
+  pthread_mutex_unlock(&map_guard_lock);
+  return ok;
+}
+
+static void map_guard_release(void) {
+  pthread_mutex_lock(&map_guard_lock);
+  if (atomic_fetch_sub(&map_live, 1) == 1) sigaction(SIGBUS, &map_old_bus, NULL);
+  pthread_mutex_unlock(&map_guard_lock);
+}
+
+bool dc_map_open(dc_map_t *m, int fd, size_t len) {
+  m->ptr = NULL;
+  m->len = 0;
+  m->slot = -1;
+
+  int slot = -1;
+  for (int i = 0; i < DC_MAP_SLOTS && slot < 0; i++) {
+    uintptr_t want = 0;
+    if (atomic_compare_exchange_strong(&map_slots[i].base, &want, (uintptr_t)1)) slot = i;
+  }
+  if (slot < 0) {
+    errno = ENOMEM;
+    return false;
+  }
+  if (!map_guard_acquire()) {
+    atomic_store(&map_slots[slot].base, (uintptr_t)0);
+    return false;
+  }
+
+  void *p = mmap(NULL, len, PROT_READ, MAP_PRIVATE, fd, 0);
+  if (p == MAP_FAILED) {
+    int saved = errno;
+    map_guard_release();
+    atomic_store(&map_slots[slot].base, (uintptr_t)0);
+    errno = saved;
+    return false;
+  }
+
+  map_slot_t *s = &map_slots[slot];
+  s->len = len;
+  s->truncated = 0;
+  atomic_store(&s->base, (uintptr_t)p);
+
+  m->ptr = (const uint8_t *)p;
+  m->len = len;
+  m->slot = slot;
+  return true;
+}
+
+bool dc_map_truncated(const dc_map_t *m) {
+  return m->ptr && map_slots[m->slot].truncated;
+}
+
+void dc_map_close(dc_map_t *m) {
+  if (!m->ptr) return;
+  map_slot_t *s = &map_slots[m->slot];
+  atomic_store(&s->base, (uintptr_t)1);
+  munmap((void *)m->ptr, m->len);
+  s->len = 0;
+  atomic_store(&s->base, (uintptr_t)0);
+  map_guard_release();
+  m->ptr = NULL;
+  m->len = 0;
+  m->slot = -1;
+}
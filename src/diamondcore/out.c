@@ -0,0 +1,230 @@
+// out.c - buffered output writer shared by the builtins
+
+#include "diamondcore.h"
+
+#include <sys/types.h>  /* ssize_t */
+#include <sys/uio.h>    /* writev, struct iovec */
+#include <errno.h>
+#include <limits.h>     /* IOV_MAX */
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+/* Private output buffer. Output is written with one syscall per full
+ * buffer instead of one libc call per field or line. */
+#define DC_OUT_BUF_SIZE ((size_t)64 * 1024)
+
+#ifndef IOV_MAX
+#define IOV_MAX 1024
+#endif
+
+struct dc_out {
+  int fd;
+  uint8_t *buf;
+  size_t len;
+  int saved_errno; /* sticky: non-zero once a write has failed */
+
+  /* Line sink mode: complete lines go to line_fn instead of the fd. The
+   * buffer grows to hold a line longer than DC_OUT_BUF_SIZE. */
+  dc_out_line_fn line_fn;
+  void *line_arg;
+  size_t cap;
+};
+
+static bool out_fail(dc_out_t *out, int e, dc_error_t *err) {
+  if (!out->saved_errno) out->saved_errno = e ? e : EIO;
+  dc_err_set(err, DC_ERR_IO, "write error: %s", strerror(out->saved_errno));
+  return false;
+}
+
+/* Write all of IOV[0..n) to the fd, handling short writes, EINTR and a
+ * non-blocking descriptor. */
+static bool write_all(dc_out_t *out, struct iovec *iov, int n, dc_error_t *err) {
+  while (n > 0) {
+    ssize_t w = writev(out->fd, iov, n > IOV_MAX ? IOV_MAX : n);
+    if (w < 0) {
+      if (errno == EINTR) continue;
+      if (errno == EAGAIN || errno == EWOULDBLOCK) {
+        struct pollfd pfd = { .fd = out->fd, .events = POLLOUT, .revents = 0 };
+        (void)poll(&pfd, 1, -1);
+        continue;
+      }
+      return out_fail(out, errno, err);
+    }
+
+    size_t left = (size_t)w;
+    while (n > 0 && left >= iov->iov_len) {
+      left -= iov->iov_len;
+      iov++;
+      n--;
+    }
+    if (n > 0) {
+      iov->iov_base = (uint8_t *)iov->iov_base + left;
+      iov->iov_len -= left;
+    }
+  }
+  return true;
+}
+
+dc_out_t *dc_out_open(FILE *fp, dc_error_t *err) {
+  dc_err_init(err);
+  if (!fp) fp = stdout;
+
+  dc_out_t *out = (dc_out_t *)calloc(1, sizeof(dc_out_t));
+  if (!out) {
+    dc_err_set(err, DC_ERR_NOMEM, "out of memory");
+    return NULL;
+  }
+  out->buf = (uint8_t *)malloc(DC_OUT_BUF_SIZE);
+  if (!out->buf) {
+    free(out);
+    dc_err_set(err, DC_ERR_NOMEM, "out of memory");
+    return NULL;
+  }
+
+  // Anything the shell already buffered in FP must reach the fd first.
+  (void)fflush(fp);
+  out->fd = fileno(fp);
+  return out;
+}
+
+dc_out_t *dc_out_open_lines(dc_out_line_fn fn, void *arg, dc_error_t *err) {
+  dc_out_t *out = dc_out_open(stdout, err);
+  if (!out) return NULL;
+  // One spare byte, so the last line can always be NUL-terminated.
+  uint8_t *nb = (uint8_t *)realloc(out->buf, DC_OUT_BUF_SIZE + 1);
+  if (!nb) {
+    dc_out_close(out, err);
+    dc_err_set(err, DC_ERR_NOMEM, "out of memory");
+    return NULL;
+  }
+  out->buf = nb;
+  out->cap = DC_OUT_BUF_SIZE + 1;
+  out->fd = -1;
+  out->line_fn = fn;
+  out->line_arg = arg;
+  return out;
+}
+
+/* Hand the complete lines in the buffer to line_fn, each NUL-terminated in
+ * place of its '\n', and keep the unterminated rest. With FINAL the rest
+ * is a line of its own. */
+static bool sink_lines(dc_out_t *out, bool final, dc_error_t *err) {
+  uint8_t *p = out->buf;
+  uint8_t *end = out->buf + out->len;
+  for (;;) {
+    uint8_t *nl = (uint8_t *)memchr(p, '\n', (size_t)(end - p));
+    if (!nl) break;
+    *nl = '\0';
+    if (!out->line_fn(out->line_arg, p, (size_t)(nl - p), err)) goto fail;
+    p = nl + 1;
+  }
+  if (final && p < end) {
+    *end = '\0'; // cap always leaves room for this byte
+    if (!out->line_fn(out->line_arg, p, (size_t)(end - p), err)) goto fail;
+    p = end;
+  }
+  out->len = (size_t)(end - p);
+  memmove(out->buf, p, out->len);
+  return true;
+
+fail:
+  // Keep the callback's message; later calls report a write error.
+  out->saved_errno = EIO;
+  out->len = 0;
+  return false;
+}
+
+/* Sink mode dc_out_write: append, then pass on lines once the buffer has
+ * filled up. */
+static bool sink_write(dc_out_t *out, const void *p, size_t n, dc_error_t *err) {
+  if (n >= out->cap - out->len) {
+    size_t ncap = out->cap;
+    while (n >= ncap - out->len) ncap *= 2;
+    uint8_t *nb = (uint8_t *)realloc(out->buf, ncap);
+    if (!nb) return out_fail(out, ENOMEM, err);
+    out->buf = nb;
+    out->cap = ncap;
+  }
+  size_t was = out->len;
+  memcpy(out->buf + out->len, p, n);
+  out->len += n;
+  if (out->len < DC_OUT_BUF_SIZE) return true;
+  // Past a long unterminated line only a new '\n' can complete anything.
+  if (was >= DC_OUT_BUF_SIZE && !memchr(p, '\n', n)) return true;
+  return sink_lines(out, false, err);
+}
+
+bool dc_out_flush(dc_out_t *out, dc_error_t *err) {
+  if (out->saved_errno) return out_fail(out, out->saved_errno, err);
+  if (out->len == 0) return true;
+  if (out->line_fn) return sink_lines(out, false, err);
+
+  struct iovec iov = { .iov_base = out->buf, .iov_len = out->len };
+  out->len = 0;
+  return write_all(out, &iov, 1, err);
+}
+
+bool dc_out_write(dc_out_t *out, const void *p, size_t n, dc_error_t *err) {
+  if (out->saved_errno) return out_fail(out, out->saved_errno, err);
+  if (out->line_fn) return sink_write(out, p, n, err);
+  if (n <= DC_OUT_BUF_SIZE - out->len) {
+    memcpy(out->buf + out->len, p, n);
+    out->len += n;
+    return true;
+  }
+
+  if (n < DC_OUT_BUF_SIZE) {
+    if (!dc_out_flush(out, err)) return false;
+    memcpy(out->buf, p, n);
+    out->len = n;
+    return true;
+  }
+
+  // Large chunk: gather pending bytes and P into one writev.
+  struct iovec iov[2] = {
+    { .iov_base = out->buf, .iov_len = out->len },
+    { .iov_base = (void *)p, .iov_len = n },
+  };
+  out->len = 0;
+  return iov[0].iov_len ? write_all(out, iov, 2, err) : write_all(out, iov + 1, 1, err);
+}
+
+bool dc_out_putc(dc_out_t *out, uint8_t c, dc_error_t *err) {
+  if (out->len < DC_OUT_BUF_SIZE && !out->saved_errno) {
+    out->buf[out->len++] = c;
+    return true;
+  }
+  return dc_out_write(out, &c, 1, err);
+}
+
+bool dc_out_join(dc_out_t *out, const dc_field_view_t *views, size_t n,
+                 uint8_t sep, dc_error_t *err) {
+  // Join straight into the buffer when it fits (always, in the common case).
+  if (!out->saved_errno && !out->line_fn) {
+    size_t len = dc_join(NULL, views, n, sep);
+    if (len > DC_OUT_BUF_SIZE - out->len && len <= DC_OUT_BUF_SIZE &&
+        !dc_out_flush(out, err))
+      return false;
+    if (len <= DC_OUT_BUF_SIZE - out->len) {
+      out->len += dc_join(out->buf + out->len, views, n, sep);
+      return true;
+    }
+  }
+  for (size_t i = 0; i < n; i++) {
+    if (i > 0 && !dc_out_putc(out, sep, err)) return false;
+    if (!dc_out_write(out, views[i].ptr, views[i].len, err)) return false;
+  }
+  return true;
+}
+
+bool dc_out_close(dc_out_t *out, dc_error_t *err) {
+  if (!out) return true;
+  bool ok = dc_out_flush(out, err) &&
+            (!out->line_fn || out->len == 0 || sink_lines(out, true, err));
+  free(out->buf);
+  free(out);
+  return ok;
+}
@@ -1,10 +1,12 @@
 // src/diamondcore/range.c
 #include <errno.h>
+#include <fcntl.h>
 #include <inttypes.h>
 #include <stdbool.h>
 #include <stdint.h>
 #include <stdlib.h>
 #include <string.h>
+#include <unistd.h>
 
 #include "diamondcore.h"
 
@@ -13,12 +15,55 @@ typedef struct {
   uint64_t end; /* UINT64_MAX means open-ended */
 } dc_range_t;
 
+/* An item with at least one bound counted from the end ("-N" is the
+ * N-th last); it is resolved once the total is known. */
+#define DC_REL_START 1u
+#define DC_REL_END   2u
+
+typedef struct {
+  uint64_t start;
+  uint64_t end;
+  unsigned rel; /* DC_REL_* bits: which bounds count from the end */
+} dc_rel_t;
+
+/* Bitmap over a dense run of ranges: bit (n - lo) is set when n in
+ * [lo, hi] is selected. */
+typedef struct {
+  uint64_t lo;
+  uint64_t hi;
+  uint64_t *bits;
+} dc_cluster_t;
+
+/* A run of at least CLUSTER_MIN_RANGES ranges becomes a bitmap when it
+ * spans no more than CLUSTER_BITS_PER_RANGE numbers per range, i.e. the
+ * bitmap is at most twice the size of the ranges it stands for. */
+#define CLUSTER_MIN_RANGES     32u
+#define CLUSTER_BITS_PER_RANGE 256u
+
+/* Forward steps tried from the cursor before falling back to a binary
+ * search. */
+#define CURSOR_GALLOP 4u
+
 struct dc_sel {
   dc_range_t *ranges;
   size_t      nranges;
   size_t      cap;
 
-  /* Streaming cursor: monotone line_no => monotone range index */
+  dc_rel_t *rel;
+  size_t    nrel;
+  size_t    relcap;
+
+  /* ranges plus rel resolved for res_total, sized at parse time */
+  dc_range_t *res;
+  size_t      nres;
+  uint64_t    res_total;
+  bool        res_valid;
+
+  /* Lookup accelerators over ranges (absolute part only) */
+  dc_cluster_t *clusters;
+  size_t        nclusters;
+
+  /* Index of the range the last query landed on; a hint only */
   size_t cursor;
 };
 
@@ -44,6 +89,21 @@ static bool add_range(dc_sel_t *sel, uint64_t a, uint64_t b, dc_error_t *err) {
   return true;
 }
 
+static bool add_rel(dc_sel_t *sel, uint64_t a, uint64_t b, unsigned rel, dc_error_t *err) {
+  if (sel->nrel == sel->relcap) {
+    size_t newcap = sel->relcap ? sel->relcap * 2 : 4;
+    void *np = realloc(sel->rel, newcap * sizeof(dc_rel_t));
+    if (!np) {
+      dc_err_set(err, DC_ERR_NOMEM, "lines: out of memory");
+      return false;
+    }
+    sel->rel = (dc_rel_t *)np;
+    sel->relcap = newcap;
+  }
+  sel->rel[sel->nrel++] = (dc_rel_t){ .start = a, .end = b, .rel = rel };
+  return true;
+}
+
 /* Strict UINT:
  * - digits only
  * - no leading zeros ("01" invalid)
@@ -91,12 +151,27 @@ static bool match_dots(const char **p) {
   return false;
 }
 
+/* BOUND := UINT | "-" UINT; a leading '-' counts from the end. */
+static bool parse_bound(const char **p, uint64_t *out, bool *from_end, dc_error_t *err) {
+  *from_end = false;
+  if (**p == '-') {
+    *from_end = true;
+    (*p)++;
+  }
+  return parse_uint_strict(p, out, err);
+}
+
+static bool at_bound(const char *s) {
+  if (*s == '-') s++;
+  return *s >= '0' && *s <= '9';
+}
+
 /*
- * ITEM := INDEX | RANGE
- * INDEX := UINT
+ * ITEM  := INDEX | RANGE
+ * INDEX := BOUND
  * RANGE := START ".." END
- * START := UINT | ε
- * END   := UINT | ε
+ * START := BOUND | ε
+ * END   := BOUND | ε
  *
  * Whitespace allowed around "," and around ".." only.
  */
@@ -108,85 +183,65 @@ static bool parse_item(const char **p, dc_sel_t *sel, dc_error_t *err) {
     return false;
   }
 
-  uint64_t start = 0, end = 0;
-  bool have_start = false, have_end = false;
+  uint64_t start = 1, end = UINT64_MAX;
+  bool start_rel = false, end_rel = false;
 
-  /* Two cases: (1) starts with ".." => open-start range; (2) starts with UINT */
   if (match_dots(p)) {
-    /* "..END" form; START is ε */
+    /* "..END" form; START is 1 and a bare ".." is invalid */
     skip_ws(p);
-    if (!p || !*p || **p == '\0') {
-      /* Bare ".." invalid */
+    if (!at_bound(*p)) {
       dc_err_set(err, DC_ERR_USAGE, "lines: invalid SPEC");
       return false;
     }
-    if (!(**p >= '0' && **p <= '9')) {
+    if (!parse_bound(p, &end, &end_rel, err)) return false;
+  } else {
+    if (!at_bound(*p)) {
       dc_err_set(err, DC_ERR_USAGE, "lines: invalid SPEC");
       return false;
     }
-    if (!parse_uint_strict(p, &end, err)) return false;
-    have_end = true;
+    if (!parse_bound(p, &start, &start_rel, err)) return false;
 
-    /* Range is 1..end */
-    if (end == 0) {
-      dc_err_set(err, DC_ERR_USAGE, "lines: invalid SPEC");
-      return false;
+    skip_ws(p);
+    if (!match_dots(p)) {
+      /* INDEX */
+      end = start;
+      end_rel = start_rel;
+    } else {
+      /* RANGE: END may be ε (open-ended) */
+      skip_ws(p);
+      if (at_bound(*p) && !parse_bound(p, &end, &end_rel, err)) return false;
     }
-    return add_range(sel, 1, end, err);
   }
 
-  /* Must start with UINT */
-  if (!(**p >= '0' && **p <= '9')) {
-    dc_err_set(err, DC_ERR_USAGE, "lines: invalid SPEC");
-    return false;
-  }
-  if (!parse_uint_strict(p, &start, err)) return false;
-  have_start = true;
-
-  /* If it's an INDEX, we're done unless a RANGE follows */
-  skip_ws(p);
-  if (!match_dots(p)) {
-    /* INDEX */
-    if (!have_start || start == 0) {
+  if (!start_rel && !end_rel) {
+    if (start > end) {
       dc_err_set(err, DC_ERR_USAGE, "lines: invalid SPEC");
       return false;
     }
-    return add_range(sel, start, start, err);
-  }
-
-  /* RANGE: START ".." END (END may be ε) */
-  skip_ws(p);
-  if (p && *p && **p != '\0') {
-    if ((**p >= '0' && **p <= '9')) {
-      if (!parse_uint_strict(p, &end, err)) return false;
-      have_end = true;
-    }
+    return add_range(sel, start, end, err);
   }
 
-  if (!have_start) {
+  /* "-a..-b" must not run backwards; mixed forms are checked on resolve. */
+  if (start_rel && end_rel && start < end) {
     dc_err_set(err, DC_ERR_USAGE, "lines: invalid SPEC");
     return false;
   }
-  if (start == 0) {
-    dc_err_set(err, DC_ERR_USAGE, "lines: invalid SPEC");
-    return false;
-  }
-
-  if (!have_end) {
-    /* "a.." open-ended */
-    return add_range(sel, start, UINT64_MAX, err);
-  }
+  return add_rel(sel, start, end,
+                 (start_rel ? DC_REL_START : 0u) | (end_rel ? DC_REL_END : 0u), err);
+}
 
-  /* closed "a..b" */
-  if (end == 0) {
-    dc_err_set(err, DC_ERR_USAGE, "lines: invalid SPEC");
-    return false;
+/* Absolute bounds of R for TOTAL items; false when it selects nothing. */
+static bool resolve_rel(const dc_rel_t *r, uint64_t total, uint64_t *lo, uint64_t *hi) {
+  uint64_t a = r->start, b = r->end;
+  if (r->rel & DC_REL_START) a = (a > total) ? 1 : total - a + 1;
+  if (r->rel & DC_REL_END) {
+    if (b > total) return false;
+    b = total - b + 1;
   }
-  if (start > end) {
-    dc_err_set(err, DC_ERR_USAGE, "lines: invalid SPEC");
-    return false;
-  }
-  return add_range(sel, start, end, err);
+  if (a > b || a > total) return false;
+  *lo = a;
+  *hi = b;
+  return true;
 }
 
 static int cmp_range(const void *A, const void *B) {
@@ -199,30 +254,27 @@ static int cmp_range(const void *A, const void *B) {
   return 0;
 }
 
-/* Merge ranges in-place; assumes sorted by (start,end). */
-static void normalize_ranges(dc_sel_t *sel) {
-  if (!sel || sel->nranges == 0) return;
+/* Sort and merge R[0..n) in place; returns the new count. */
+static size_t merge_ranges(dc_range_t *r, size_t n) {
+  if (n == 0) return 0;
 
-  qsort(sel->ranges, sel->nranges, sizeof(dc_range_t), cmp_range);
+  qsort(r, n, sizeof(dc_range_t), cmp_range);
 
   size_t w = 0;
-  for (size_t r = 0; r < sel->nranges; r++) {
-    dc_range_t cur = sel->ranges[r];
+  for (size_t i = 0; i < n; i++) {
+    dc_range_t cur = r[i];
     if (w == 0) {
-      sel->ranges[w++] = cur;
+      r[w++] = cur;
       continue;
     }
 
-    dc_range_t *prev = &sel->ranges[w - 1];
+    dc_range_t *prev = &r[w - 1];
 
     /* Overlap or adjacency merges (dedup) */
-    uint64_t prev_end = prev->end;
-    uint64_t cur_start = cur.start;
-
     bool adjacent_or_overlap = false;
-    if (prev_end == UINT64_MAX) {
+    if (prev->end == UINT64_MAX) {
       adjacent_or_overlap = true;
-    } else if (cur_start <= prev_end + 1) {
+    } else if (cur.start <= prev->end + 1) {
       adjacent_or_overlap = true;
     }
 
@@ -234,15 +286,112 @@ static void normalize_ranges(dc_sel_t *sel) {
         prev->end = cur.end;
       }
     } else {
-      sel->ranges[w++] = cur;
+      r[w++] = cur;
     }
   }
+  return w;
+}
 
-  sel->nranges = w;
+static void normalize_ranges(dc_sel_t *sel) {
+  if (!sel) return;
+  sel->nranges = merge_ranges(sel->ranges, sel->nranges);
   sel->cursor = 0;
 }
 
-dc_sel_t *dc_sel_parse_and_normalize(const char *spec, dc_error_t *err) {
+static void free_clusters(dc_sel_t *sel) {
+  for (size_t i = 0; i < sel->nclusters; i++) free(sel->clusters[i].bits);
+  free(sel->clusters);
+  sel->clusters = NULL;
+  sel->nclusters = 0;
+}
+
+static void set_bits(uint64_t *bits, uint64_t a, uint64_t b) {
+  for (uint64_t i = a; i <= b;) {
+    if ((i & 63) == 0 && b - i >= 63) {
+      bits[i >> 6] = ~(uint64_t)0;
+      i += 64;
+    } else {
+      bits[i >> 6] |= (uint64_t)1 << (i & 63);
+      i++;
+    }
+  }
+}
+
+/* Cover dense runs of many small ranges with bitmaps. Best effort: on
+ * allocation failure lookups simply use the ranges. */
+static void build_clusters(dc_sel_t *sel) {
+  free_clusters(sel);
+  if (sel->nranges < CLUSTER_MIN_RANGES) return;
+
+  size_t cap = 0;
+  for (size_t i = 0; i < sel->nranges;) {
+    size_t j = i;
+    while (j + 1 < sel->nranges && sel->ranges[j + 1].end != UINT64_MAX &&
+           sel->ranges[j + 1].end - sel->ranges[i].start <
+               (uint64_t)(j + 2 - i) * CLUSTER_BITS_PER_RANGE) {
+      j++;
+    }
+    if (j + 1 - i < CLUSTER_MIN_RANGES || sel->ranges[j].end == UINT64_MAX) {
+      i++;
+      continue;
+    }
+
+    if (sel->nclusters == cap) {
+      size_t ncap = cap ? cap * 2 : 4;
+      dc_cluster_t *nc = (dc_cluster_t *)realloc(sel->clusters, ncap * sizeof(*nc));
+      if (!nc) break;
+      sel->clusters = nc;
+      cap = ncap;
+    }
+    uint64_t lo = sel->ranges[i].start, hi = sel->ranges[j].end;
+    uint64_t *bits = (uint64_t *)calloc((size_t)((hi - lo) / 64 + 1), sizeof(uint64_t));
+    if (!bits) break;
+    for (size_t k = i; k <= j; k++) set_bits(bits, sel->ranges[k].start - lo, sel->ranges[k].end - lo);
+    sel->clusters[sel->nclusters++] = (dc_cluster_t){ .lo = lo, .hi = hi, .bits = bits };
+    i = j + 1;
+  }
+}
+
+/* -1 if no bitmap covers N, else whether N is selected. */
+static int cluster_lookup(const dc_sel_t *sel, uint64_t n) {
+  size_t lo = 0, hi = sel->nclusters;
+  while (lo < hi) {
+    size_t mid = lo + (hi - lo) / 2;
+    if (sel->clusters[mid].hi < n) lo = mid + 1;
+    else hi = mid;
+  }
+  if (lo == sel->nclusters || sel->clusters[lo].lo > n) return -1;
+  uint64_t b = n - sel->clusters[lo].lo;
+  return (int)((sel->clusters[lo].bits[b >> 6] >> (b & 63)) & 1);
+}
+
+/* Index of the first range ending at or after N (nranges if none). */
+static size_t find_range(const dc_range_t *r, size_t lo, size_t hi, uint64_t n) {
+  while (lo < hi) {
+    size_t mid = lo + (hi - lo) / 2;
+    if (r[mid].end < n) lo = mid + 1;
+    else hi = mid;
+  }
+  return lo;
+}
+
+/* find_range over all ranges, starting from the cursor: a few linear
+ * steps cover monotone callers, anything else is a binary search. */
+static size_t seek_range(dc_sel_t *sel, uint64_t n) {
+  size_t c = sel->cursor;
+  if (c > sel->nranges) c = sel->nranges;
+  if (c > 0 && sel->ranges[c - 1].end >= n) {
+    c = find_range(sel->ranges, 0, c, n); /* moved backwards */
+  } else {
+    size_t steps = 0;
+    while (c < sel->nranges && sel->ranges[c].end < n && steps++ < CURSOR_GALLOP) c++;
+    if (c < sel->nranges && sel->ranges[c].end < n) c = find_range(sel->ranges, c, sel->nranges, n);
+  }
+  sel->cursor = c;
+  return c;
+}
+
+static dc_sel_t *parse_spec(const char *spec, dc_error_t *err) {
   if (err) memset(err,0, sizeof(*err));
 
   if (!spec || *spec == '\0') {
@@ -300,33 +449,222 @@ dc_sel_t *dc_sel_parse_and_normalize(const char *spec, dc_error_t *err) {
     }
   }
 
-  if (!parsed_any || sel->nranges == 0) {
+  if (!parsed_any || sel->nranges + sel->nrel == 0) {
     dc_err_set(err, DC_ERR_USAGE, "lines: invalid SPEC");
     dc_sel_free(sel);
     return NULL;
   }
 
   normalize_ranges(sel);
+  build_clusters(sel);
+
+  if (sel->nrel > 0) {
+    sel->res = (dc_range_t *)malloc((sel->nranges + sel->nrel) * sizeof(dc_range_t));
+    if (!sel->res) {
+      dc_err_set(err, DC_ERR_NOMEM, "lines: out of memory");
+      dc_sel_free(sel);
+      return NULL;
+    }
+  }
+  return sel;
+}
+
+/* Read "@FILE" into one SPEC string: each non-blank line holds one or
+ * more items, and line breaks separate items like ','. */
+static char *load_spec_file(const char *path, dc_error_t *err) {
+  int fd = open(path, O_RDONLY | O_CLOEXEC);
+  if (fd < 0) {
+    dc_err_set(err, DC_ERR_USAGE, "lines: cannot open SPEC file '%s': %s", path, strerror(errno));
+    return NULL;
+  }
+
+  size_t len = 0, cap = 4096;
+  char *buf = (char *)malloc(cap);
+  for (;;) {
+    if (buf && cap - len < 2048) {
+      char *nb = (char *)realloc(buf, cap * 2);
+      if (!nb) {
+        free(buf);
+        buf = NULL;
+      } else {
+        buf = nb;
+        cap *= 2;
+      }
+    }
+    if (!buf) {
+      close(fd);
+      dc_err_set(err, DC_ERR_NOMEM, "lines: out of memory");
+      return NULL;
+    }
+    ssize_t n = read(fd, buf + len, cap - len - 1);
+    if (n < 0 && errno == EINTR) continue;
+    if (n < 0) {
+      dc_err_set(err, DC_ERR_USAGE, "lines: cannot read SPEC file '%s': %s", path, strerror(errno));
+      close(fd);
+      free(buf);
+      return NULL;
+    }
+    if (n == 0) break;
+    len += (size_t)n;
+  }
+  close(fd);
+
+  if (memchr(buf, '\0', len)) {
+    dc_err_set(err, DC_ERR_USAGE, "lines: invalid SPEC");
+    free(buf);
+    return NULL;
+  }
+
+  /* Join the non-blank lines with ',' in place (never longer). */
+  size_t w = 0;
+  for (size_t r = 0; r < len;) {
+    size_t e = r;
+    while (e < len && buf[e] != '\n') e++;
+    size_t a = r, b = e;
+    while (a < b && (is_ws(buf[a]) || buf[a] == '\r')) a++;
+    while (b > a && (is_ws(buf[b - 1]) || buf[b - 1] == '\r')) b--;
+    if (b > a) {
+      if (w > 0) buf[w++] = ',';
+      memmove(buf + w, buf + a, b - a);
+      w += b - a;
+    }
+    r = e + 1;
+  }
+  buf[w] = '\0';
+  return buf;
+}
+
+dc_sel_t *dc_sel_parse_and_normalize(const char *spec, dc_error_t *err) {
+  if (!spec || spec[0] != '@') return parse_spec(spec, err);
+
+  dc_err_init(err);
+  char *text = load_spec_file(spec + 1, err);
+  if (!text) return NULL;
+  dc_sel_t *sel = parse_spec(text, err);
+  free(text);
   return sel;
 }
 
+uint64_t dc_sel_tail_span(const dc_sel_t *sel) {
+  uint64_t span = 0;
+  if (!sel) return 0;
+  for (size_t i = 0; i < sel->nrel; i++) {
+    const dc_rel_t *r = &sel->rel[i];
+    if ((r->rel & DC_REL_START) && r->start > span) span = r->start;
+    if ((r->rel & DC_REL_END) && r->end > span) span = r->end;
+  }
+  return span;
+}
+
+bool dc_sel_tail_only(const dc_sel_t *sel) {
+  if (!sel || sel->nranges > 0 || sel->nrel == 0) return false;
+  for (size_t i = 0; i < sel->nrel; i++) {
+    const dc_rel_t *r = &sel->rel[i];
+    if (!(r->rel & DC_REL_START)) return false;
+    if (!(r->rel & DC_REL_END) && r->end != UINT64_MAX) return false;
+  }
+  return true;
+}
+
+/* Absolute ranges plus REL resolved for TOTAL, merged into sel->res. */
+static const dc_range_t *resolved(dc_sel_t *sel, uint64_t total, size_t *n) {
+  if (sel->nrel == 0) {
+    *n = sel->nranges;
+    return sel->ranges;
+  }
+  if (!sel->res_valid || sel->res_total != total) {
+    size_t w = sel->nranges;
+    if (w > 0) memcpy(sel->res, sel->ranges, w * sizeof(dc_range_t));
+    for (size_t i = 0; i < sel->nrel; i++) {
+      uint64_t lo, hi;
+      if (resolve_rel(&sel->rel[i], total, &lo, &hi)) sel->res[w++] = (dc_range_t){ .start = lo, .end = hi };
+    }
+    sel->nres = merge_ranges(sel->res, w);
+    sel->res_total = total;
+    sel->res_valid = true;
+  }
+  *n = sel->nres;
+  return sel->res;
+}
+
+void dc_sel_resolve(dc_sel_t *sel, uint64_t total) {
+  if (!sel || sel->nrel == 0) return;
+  size_t n = 0;
+  (void)resolved(sel, total, &n);
+
+  /* The resolved list becomes the plain absolute selection. */
+  free(sel->ranges);
+  sel->ranges = sel->res;
+  sel->nranges = n;
+  sel->cap = n;
+  sel->res = NULL;
+  sel->res_valid = false;
+  sel->nrel = 0;
+  sel->cursor = 0;
+  build_clusters(sel);
+}
+
+bool dc_sel_wants_at(const dc_sel_t *sel, uint64_t n, uint64_t total) {
+  if (!sel) return false;
+
+  int bit = cluster_lookup(sel, n);
+  if (bit > 0) return true;
+  if (bit < 0) {
+    size_t i = find_range(sel->ranges, 0, sel->nranges, n);
+    if (i < sel->nranges && sel->ranges[i].start <= n) return true;
+  }
+
+  for (size_t i = 0; i < sel->nrel; i++) {
+    uint64_t a, b;
+    if (resolve_rel(&sel->rel[i], total, &a, &b) && n >= a && n <= b) return true;
+  }
+  return false;
+}
+
 bool dc_sel_wants(dc_sel_t *sel, uint64_t line_no) {
   if (!sel || sel->nranges == 0) return false;
 
-  /* Advance cursor while line_no is beyond current range end */
-  while (sel->cursor < sel->nranges) {
-    dc_range_t r = sel->ranges[sel->cursor];
-    if (line_no < r.start) return false;
-    if (r.end == UINT64_MAX) return true;
-    if (line_no <= r.end) return true;
-    sel->cursor++;
+  int bit = cluster_lookup(sel, line_no);
+  if (bit >= 0) return bit != 0;
+
+  size_t i = seek_range(sel, line_no);
+  return i < sel->nranges && sel->ranges[i].start <= line_no;
+}
+
+uint64_t dc_sel_next(dc_sel_t *sel, uint64_t from) {
+  if (!sel) return 0;
+  size_t i = seek_range(sel, from);
+  if (i == sel->nranges) return 0;
+  return from < sel->ranges[i].start ? sel->ranges[i].start : from;
+}
+
+void dc_sel_reset(dc_sel_t *sel) {
+  if (sel) sel->cursor = 0;
+}
+
+size_t dc_sel_gather(dc_sel_t *sel, dc_field_view_t *fields, size_t nfields) {
+  if (!sel || !fields) return 0;
+
+  size_t nr = 0;
+  const dc_range_t *ranges = resolved(sel, nfields, &nr);
+
+  /* Normalized ranges are sorted, disjoint runs of 1-based indices, so each
+   * one is a single contiguous move; an open end runs to NFIELDS. */
+  size_t w = 0;
+  for (size_t i = 0; i < nr; i++) {
+    dc_range_t r = ranges[i];
+    if (r.start > (uint64_t)nfields) break;
+    size_t lo = (size_t)(r.start - 1);
+    size_t hi = (r.end >= (uint64_t)nfields) ? nfields : (size_t)r.end;
+    if (w != lo) memmove(fields + w, fields + lo, (hi - lo) * sizeof(*fields));
+    w += hi - lo;
   }
-  return false;
+  return w;
 }
 
 uint64_t dc_sel_max_finite(dc_sel_t *sel, bool *has_max) {
   if (has_max) *has_max = false;
-  if (!sel || sel->nranges == 0) return 0;
+  if (!sel || sel->nranges == 0 || sel->nrel > 0) return 0;
 
   for (size_t i = 0; i < sel->nranges; i++) {
     if (sel->ranges[i].end == UINT64_MAX) {
@@ -345,6 +683,9 @@ uint64_t dc_sel_max_finite(dc_sel_t *sel, bool *has_max) {
 
 void dc_sel_free(dc_sel_t *sel) {
   if (!sel) return;
+  free_clusters(sel);
   free(sel->ranges);
+  free(sel->rel);
+  free(sel->res);
   free(sel);
 }
@@ -1,48 +1,10 @@
-#include "dc_regex.h"
+#include "regex_int.h"
 
 #include <stdlib.h>
 #include <string.h>
 #include <stdio.h>
 
-typedef enum {
-  I_MATCH = 0,
-  I_CHAR,
-  I_ANY,
-  I_CLASS,
-  I_JMP,
-  I_SPLIT,
-  I_EOL
-} op_t;
-
-typedef struct {
-  op_t op;
-  int x;
-  int y;
-  uint16_t cls;
-  uint8_t c;
-} inst_t;
-
-typedef struct {
-  uint8_t bits[32]; /* 256-bit */
-} cls_t;
-
-struct dc_regex {
-  inst_t *prog;
-  int prog_len;
-
-  cls_t *classes;
-  int class_len;
-
-  int start_pc;
-
-  bool anchor_start;
-  bool anchor_end;
-
-  /* program allocated size fixed at max */
-};
-
 static void bitset_set(uint8_t bits[32], uint8_t b) { bits[b >> 3] |= (uint8_t)(1u << (b & 7)); }
-static bool bitset_test(const uint8_t bits[32], uint8_t b) { return (bits[b >> 3] & (uint8_t)(1u << (b & 7))) != 0; }
 static void bitset_invert(uint8_t bits[32]) { for (int i = 0; i < 32; i++) bits[i] = (uint8_t)~bits[i]; }
 
 typedef struct {
@@ -109,6 +71,7 @@ typedef struct {
   bool ok;
 
   int cls_cap;
+  int prog_cap;
   bool allow_empty;
 } parser_t;
 
@@ -137,12 +100,25 @@ static int emit_inst(parser_t *ps, inst_t ins) {
     perr(ps, "match: pattern compile error");
     return -1;
   }
+  if (ps->re->prog_len == ps->prog_cap) {
+    // Grown on demand: most programs are a few dozen instructions.
+    int nc = ps->prog_cap == 0 ? 64 : ps->prog_cap * 2;
+    if (nc > DC_REGEX_MAX_PROG_INSN) nc = DC_REGEX_MAX_PROG_INSN;
+    inst_t *np = (inst_t *)realloc(ps->re->prog, (size_t)nc * sizeof(inst_t));
+    if (!np) { perr(ps, "match: out of memory"); return -1; }
+    ps->re->prog = np;
+    ps->prog_cap = nc;
+  }
   ps->re->prog[ps->re->prog_len] = ins;
   return ps->re->prog_len++;
 }
 
 static int add_class(parser_t *ps, const cls_t *c) {
   if (!ps->ok) return -1;
+  // Equal classes share one bitmap (`[0-9]+\.[0-9]+` needs just one).
+  for (int i = 0; i < ps->re->class_len; i++) {
+    if (memcmp(ps->re->classes[i].bits, c->bits, sizeof(c->bits)) == 0) return i;
+  }
   if (ps->re->class_len == ps->cls_cap) {
     int nc = (ps->cls_cap == 0) ? 16 : ps->cls_cap * 2;
     cls_t *np = (cls_t *)realloc(ps->re->classes, (size_t)nc * sizeof(cls_t));
@@ -159,8 +135,8 @@ static void patch(parser_t *ps, const plist_t *pl, int target) {
     int enc = pl->p[i];
     int idx = enc >> 1;
     int fld = enc & 1;
-    if (fld == 0) ps->re->prog[idx].x = target;
-    else ps->re->prog[idx].y = target;
+    if (fld == 0) ps->re->prog[idx].x = (int16_t)target;
+    else ps->re->prog[idx].y = (int16_t)target;
   }
 }
 
@@ -303,7 +279,10 @@ static frag_t parse_atom(parser_t *ps) {
     getc_ps(ps);
     if (at_end(ps) || peek(ps) == ')') { perr(ps, "match: pattern compile error"); return frag_invalid(); }
     frag_t inner = parse_alt(ps);
-    if (!inner.valid || !ps->ok) return frag_invalid();
+    if (!inner.valid || !ps->ok) {
+      if (inner.valid) plist_free(&inner.out);
+      return frag_invalid();
+    }
     if (at_end(ps) || peek(ps) != ')') { perr(ps, "match: pattern compile error"); plist_free(&inner.out); return frag_invalid(); }
     getc_ps(ps);
     return inner;
@@ -365,7 +344,7 @@ static frag_t parse_repeat(parser_t *ps) {
 
   if (q == '?') {
     inst_t s; memset(&s, 0, sizeof(s));
-    s.op = I_SPLIT; s.x = a.start; s.y = -1;
+    s.op = I_SPLIT; s.x = (int16_t)a.start; s.y = -1;
     int pc = emit_inst(ps, s);
     if (pc < 0) { plist_free(&a.out); return frag_invalid(); }
 
@@ -379,7 +358,7 @@ static frag_t parse_repeat(parser_t *ps) {
 
   if (q == '*') {
     inst_t s; memset(&s, 0, sizeof(s));
-    s.op = I_SPLIT; s.x = a.start; s.y = -1;
+    s.op = I_SPLIT; s.x = (int16_t)a.start; s.y = -1;
     int pc = emit_inst(ps, s);
     if (pc < 0) { plist_free(&a.out); return frag_invalid(); }
     patch(ps, &a.out, pc);
@@ -392,7 +371,7 @@ static frag_t parse_repeat(parser_t *ps) {
 
   /* '+' */
   inst_t s; memset(&s, 0, sizeof(s));
-  s.op = I_SPLIT; s.x = a.start; s.y = -1;
+  s.op = I_SPLIT; s.x = (int16_t)a.start; s.y = -1;
   int pc = emit_inst(ps, s);
   if (pc < 0) { plist_free(&a.out); return frag_invalid(); }
   patch(ps, &a.out, pc);
@@ -450,7 +429,7 @@ static frag_t parse_alt(parser_t *ps) {
     }
 
     inst_t s; memset(&s, 0, sizeof(s));
-    s.op = I_SPLIT; s.x = left.start; s.y = right.start;
+    s.op = I_SPLIT; s.x = (int16_t)left.start; s.y = (int16_t)right.start;
     int pc = emit_inst(ps, s);
     if (pc < 0) { plist_free(&left.out); plist_free(&right.out); return frag_invalid(); }
 
@@ -488,9 +467,9 @@ static bool is_escaped_at(const char *p, size_t idx) {
   return (n & 1) == 1;
 }
 
-static void detect_global_anchors(const char *pat, size_t len,
-                                  bool *out_bol, bool *out_eol,
-                                  size_t *out_start, size_t *out_end) {
+void dc_re_split_anchors(const char *pat, size_t len,
+                         bool *out_bol, bool *out_eol,
+                         size_t *out_start, size_t *out_end) {
   *out_bol = false; *out_eol = false;
   *out_start = 0; *out_end = len;
 
@@ -517,6 +496,17 @@ static void detect_global_anchors(const char *pat, size_t len,
   }
 }
 
+/* Give back the unused tail of the doubling growth; a failed shrink just
+ * keeps the larger block. */
+static void shrink_to_fit(dc_regex_t *re) {
+  inst_t *np = (inst_t *)realloc(re->prog, (size_t)re->prog_len * sizeof(inst_t));
+  if (np) re->prog = np;
+  if (re->class_len > 0) {
+    cls_t *nc = (cls_t *)realloc(re->classes, (size_t)re->class_len * sizeof(cls_t));
+    if (nc) re->classes = nc;
+  }
+}
+
 /* Public API */
 
 bool dc_regex_compile(dc_regex_t **out_re, const char *pattern, char errbuf[256]) {
@@ -532,16 +522,14 @@ bool dc_regex_compile(dc_regex_t **out_re, const char *pattern, char errbuf[256]
   dc_regex_t *re = (dc_regex_t *)calloc(1, sizeof(dc_regex_t));
   if (!re) { if (errbuf) snprintf(errbuf, 256, "match: out of memory"); return false; }
 
-  re->prog = (inst_t *)calloc(DC_REGEX_MAX_PROG_INSN, sizeof(inst_t));
-  if (!re->prog) { free(re); if (errbuf) snprintf(errbuf, 256, "match: out of memory"); return false; }
-
+  re->prog = NULL;
   re->prog_len = 0;
   re->classes = NULL;
   re->class_len = 0;
 
   bool bol = false, eol = false;
   size_t start = 0, end = plen;
-  detect_global_anchors(pattern, plen, &bol, &eol, &start, &end);
+  dc_re_split_anchors(pattern, plen, &bol, &eol, &start, &end);
   re->anchor_start = bol;
   re->anchor_end = eol;
 
@@ -557,6 +545,7 @@ bool dc_regex_compile(dc_regex_t **out_re, const char *pattern, char errbuf[256]
   ps.err = errbuf;
   ps.ok = true;
   ps.cls_cap = 0;
+  ps.prog_cap = 0;
   ps.allow_empty = true;
 
   frag_t f;
@@ -599,12 +588,23 @@ bool dc_regex_compile(dc_regex_t **out_re, const char *pattern, char errbuf[256]
   plist_free(&f.out);
 
   re->start_pc = f.start;
+  re->has_eol = re->anchor_end;
+  shrink_to_fit(re);
+  dc_re_prefilter_init(re);
+  re->bitpar = dc_re_bitpar_new(re); /* optional, like the DFA */
+
+  re->ctx = dc_regex_ctx_new(re);
+  if (!re->ctx) { dc_regex_free(re); if (errbuf) snprintf(errbuf, 256, "match: out of memory"); return false; }
+
   *out_re = re;
   return true;
 }
 
 void dc_regex_free(dc_regex_t *re) {
   if (!re) return;
+  dc_regex_ctx_free(re->ctx);
+  dc_re_set_free(re->set);
+  dc_re_bitpar_free(re->bitpar);
   free(re->prog);
   free(re->classes);
   free(re);
@@ -612,50 +612,32 @@ void dc_regex_free(dc_regex_t *re) {
 
 /* VM */
 
-typedef struct { int pc; size_t pos; } work_t;
-
-typedef struct {
-  int *pcs;
-  int n;
-  int cap;
-} slist_t;
-
-static bool slist_init(slist_t *sl, int cap) {
+bool dc_re_slist_init(slist_t *sl, int cap) {
   sl->pcs = (int *)malloc((size_t)cap * sizeof(int));
-  if (!sl->pcs) return false;
-  sl->n = 0; sl->cap = cap;
-  return true;
+  sl->n = 0;
+  sl->cap = sl->pcs ? cap : 0;
+  return sl->pcs != NULL;
 }
-static void slist_reset(slist_t *sl) { sl->n = 0; }
-static void slist_free(slist_t *sl) { free(sl->pcs); sl->pcs = NULL; sl->n = sl->cap = 0; }
+void dc_re_slist_free(slist_t *sl) { free(sl->pcs); sl->pcs = NULL; sl->n = sl->cap = 0; }
 static bool slist_push(slist_t *sl, int pc) { if (sl->n >= sl->cap) return false; sl->pcs[sl->n++] = pc; return true; }
 
-static bool list_has_match(const dc_regex_t *re, const slist_t *sl) {
+bool dc_re_list_has_match(const dc_regex_t *re, const slist_t *sl) {
   for (int i = 0; i < sl->n; i++) if (re->prog[sl->pcs[i]].op == I_MATCH) return true;
   return false;
 }
 
-static bool addstate(const dc_regex_t *re,
-                     slist_t *dst,
-                     uint32_t *mark,
-                     uint32_t gen,
-                     int pc,
-                     size_t pos,
-                     size_t subj_len,
-                     uint64_t *steps,
-                     bool *limit) {
-  work_t stack[DC_REGEX_MAX_ACTIVE_STATES];
+bool dc_re_closure(const dc_regex_t *re, slist_t *dst, uint32_t *mark, uint32_t gen,
+                   int pc, bool at_end, uint64_t *steps) {
+  int stack[DC_REGEX_MAX_ACTIVE_STATES];
   int sp = 0;
 
-  stack[sp++] = (work_t){ .pc = pc, .pos = pos };
+  stack[sp++] = pc;
 
   while (sp > 0) {
-    work_t w = stack[--sp];
+    int cpc = stack[--sp];
 
     (*steps)++;
-    if (*steps > DC_REGEX_MAX_STEPS) { *limit = true; return false; }
 
-    int cpc = w.pc;
     if (cpc < 0 || cpc >= re->prog_len) continue;
     if (mark[cpc] == gen) continue;
     mark[cpc] = gen;
@@ -663,23 +645,23 @@ static bool addstate(const dc_regex_t *re,
     inst_t ins = re->prog[cpc];
     switch (ins.op) {
       case I_JMP:
-        if (sp >= DC_REGEX_MAX_ACTIVE_STATES) { *limit = true; return false; }
-        stack[sp++] = (work_t){ .pc = ins.x, .pos = w.pos };
+        if (sp >= DC_REGEX_MAX_ACTIVE_STATES) return false;
+        stack[sp++] = ins.x;
         break;
       case I_SPLIT:
-        if (sp + 2 >= DC_REGEX_MAX_ACTIVE_STATES) { *limit = true; return false; }
-        stack[sp++] = (work_t){ .pc = ins.x, .pos = w.pos };
-        stack[sp++] = (work_t){ .pc = ins.y, .pos = w.pos };
+        if (sp + 2 >= DC_REGEX_MAX_ACTIVE_STATES) return false;
+        stack[sp++] = ins.x;
+        stack[sp++] = ins.y;
         break;
       case I_EOL:
-        if (w.pos == subj_len) {
-          if (sp >= DC_REGEX_MAX_ACTIVE_STATES) { *limit = true; return false; }
-          stack[sp++] = (work_t){ .pc = ins.x, .pos = w.pos };
+        if (at_end) {
+          if (sp >= DC_REGEX_MAX_ACTIVE_STATES) return false;
+          stack[sp++] = ins.x;
         }
         break;
       default:
-        if (dst->n >= DC_REGEX_MAX_ACTIVE_STATES) { *limit = true; return false; }
-        if (!slist_push(dst, cpc)) { *limit = true; return false; }
+        if (dst->n >= DC_REGEX_MAX_ACTIVE_STATES) return false;
+        if (!slist_push(dst, cpc)) return false;
         break;
     }
   }
@@ -687,103 +669,264 @@ static bool addstate(const dc_regex_t *re,
   return true;
 }
 
-bool dc_regex_match_line(const dc_regex_t *re,
-                         const uint8_t *subject,
-                         size_t subject_len,
-                         bool *exec_limit_exceeded) {
-  if (exec_limit_exceeded) *exec_limit_exceeded = false;
-  if (!re) return false;
+bool dc_re_step(const dc_regex_t *re, const slist_t *clist, uint8_t b, bool at_end,
+                slist_t *nlist, uint32_t *mark, uint32_t gen, uint64_t *steps) {
+  for (int si = 0; si < clist->n; si++) {
+    int pc = clist->pcs[si];
+    (*steps)++;
+
+    inst_t ins = re->prog[pc];
+    bool take = false;
+    if (ins.op == I_CHAR) take = (ins.c == b);
+    else if (ins.op == I_ANY) take = true;
+    else if (ins.op == I_CLASS) take = ins.cls < (uint16_t)re->class_len && dc_re_bitset_test(re->classes[ins.cls].bits, b);
 
-  uint32_t *mark = (uint32_t *)calloc((size_t)re->prog_len, sizeof(uint32_t));
-  if (!mark) return false;
+    if (take && !dc_re_closure(re, nlist, mark, gen, ins.x, at_end, steps)) return false;
+  }
 
-  slist_t clist, nlist;
-  if (!slist_init(&clist, DC_REGEX_MAX_ACTIVE_STATES) ||
-      !slist_init(&nlist, DC_REGEX_MAX_ACTIVE_STATES)) {
-    free(mark);
-    if (clist.pcs) slist_free(&clist);
+  /* restart NFA at next position */
+  if (!re->anchor_start && !dc_re_closure(re, nlist, mark, gen, re->start_pc, at_end, steps)) return false;
+  return true;
+}
+
+bool dc_re_scratch_init(dc_re_scratch_t *sc, int prog_len) {
+  memset(sc, 0, sizeof(*sc));
+  // The mark array admits each pc to a list once, so a list never holds
+  // more than prog_len entries; past the active-state limit the closure
+  // reports the limit before pushing.
+  int cap = prog_len < DC_REGEX_MAX_ACTIVE_STATES ? prog_len : DC_REGEX_MAX_ACTIVE_STATES;
+  if (cap < 1) cap = 1;
+  sc->mark = (uint32_t *)calloc(prog_len > 0 ? (size_t)prog_len : 1, sizeof(uint32_t));
+  if (!sc->mark ||
+      !dc_re_slist_init(&sc->a, cap) ||
+      !dc_re_slist_init(&sc->b, cap)) {
+    dc_re_scratch_free(sc);
     return false;
   }
+  return true;
+}
 
-  uint32_t gen = 1;
-  uint64_t steps = 0;
-  bool limit = false;
+void dc_re_scratch_free(dc_re_scratch_t *sc) {
+  dc_re_slist_free(&sc->a);
+  dc_re_slist_free(&sc->b);
+  free(sc->mark);
+  sc->mark = NULL;
+}
 
-  slist_reset(&clist);
-  slist_reset(&nlist);
+/* Generation 0 is never handed out, so a zeroed mark array is "unvisited". */
+uint32_t dc_re_next_gen(dc_re_scratch_t *sc, int prog_len) {
+  if (++sc->gen == 0) {
+    memset(sc->mark, 0, (size_t)prog_len * sizeof(uint32_t));
+    sc->gen = 1;
+  }
+  return sc->gen;
+}
 
-  if (!addstate(re, &clist, mark, gen++, re->start_pc, 0, subject_len, &steps, &limit)) goto out;
+bool dc_re_nfa_run(const dc_regex_t *re, dc_re_scratch_t *sc,
+                   const uint8_t *subject, size_t subject_len, size_t pos,
+                   uint64_t steps, bool *limit) {
+  for (size_t i = pos; i < subject_len; i++) {
+    sc->b.n = 0;
+    uint32_t gen = dc_re_next_gen(sc, re->prog_len);
+    if (!dc_re_step(re, &sc->a, subject[i], i + 1 == subject_len, &sc->b, sc->mark, gen, &steps) ||
+        steps > DC_REGEX_MAX_STEPS) {
+      *limit = true;
+      return false;
+    }
 
-  if (list_has_match(re, &clist)) { slist_free(&clist); slist_free(&nlist); free(mark); return true; }
+    slist_t tmp = sc->a; sc->a = sc->b; sc->b = tmp;
+    if (dc_re_list_has_match(re, &sc->a)) return true;
+    if (re->anchor_start && sc->a.n == 0) return false;
+  }
+  return false;
+}
 
-  if (re->anchor_start) {
-    for (size_t i = 0; i < subject_len; i++) {
-      slist_reset(&nlist);
+dc_regex_ctx_t *dc_regex_ctx_new(const dc_regex_t *re) {
+  if (!re) return NULL;
+  dc_regex_ctx_t *ctx = (dc_regex_ctx_t *)calloc(1, sizeof(dc_regex_ctx_t));
+  if (!ctx) return NULL;
+  if (re->set) {
+    /* A set only dispatches to its sub-patterns' contexts. */
+    ctx->sub = (dc_regex_ctx_t **)calloc(re->set->nsub ? re->set->nsub : 1, sizeof(*ctx->sub));
+    if (!ctx->sub) {
+      free(ctx);
+      return NULL;
+    }
+    for (; ctx->nsub < re->set->nsub; ctx->nsub++) {
+      if (!(ctx->sub[ctx->nsub] = dc_regex_ctx_new(re->set->sub[ctx->nsub]))) {
+        dc_regex_ctx_free(ctx);
+        return NULL;
+      }
+    }
+    return ctx;
+  }
+  if (!dc_re_scratch_init(&ctx->sc, re->prog_len)) {
+    free(ctx);
+    return NULL;
+  }
+  /* Optional accelerator; without it matching falls back to the VM. */
+  ctx->dfa = dc_re_dfa_new(re);
+  return ctx;
+}
 
-      for (int si = 0; si < clist.n; si++) {
-        int pc = clist.pcs[si];
+size_t dc_re_mem_size(const dc_regex_t *re) {
+  size_t n = sizeof(*re) + (size_t)re->prog_len * sizeof(inst_t) + (size_t)re->class_len * sizeof(cls_t) +
+             dc_re_bitpar_mem_size(re->bitpar) + (re->set ? dc_re_set_mem_size(re->set) : 0);
+  if (re->ctx) {
+    const dc_re_scratch_t *sc = &re->ctx->sc;
+    n += sizeof(*re->ctx) + (size_t)(sc->a.cap + sc->b.cap) * sizeof(int) +
+         (size_t)re->prog_len * sizeof(uint32_t) + dc_re_dfa_mem_size(re->ctx->dfa);
+  }
+  return n;
+}
 
-        steps++;
-        if (steps > DC_REGEX_MAX_STEPS) { limit = true; break; }
+void dc_regex_ctx_free(dc_regex_ctx_t *ctx) {
+  if (!ctx) return;
+  for (size_t i = 0; i < ctx->nsub; i++) dc_regex_ctx_free(ctx->sub[i]);
+  free(ctx->sub);
+  dc_re_dfa_free(ctx->dfa);
+  dc_re_scratch_free(&ctx->sc);
+  free(ctx);
+}
 
-        inst_t ins = re->prog[pc];
-        uint8_t b = subject[i];
+static bool nfa_match(const dc_regex_t *re, dc_re_scratch_t *sc,
+                      const uint8_t *subject, size_t subject_len, bool *limit) {
+  uint64_t steps = 0;
+  uint32_t gen = dc_re_next_gen(sc, re->prog_len);
 
-        if (ins.op == I_CHAR) {
-          if (ins.c == b) if (!addstate(re, &nlist, mark, gen, ins.x, i + 1, subject_len, &steps, &limit)) break;
-        } else if (ins.op == I_ANY) {
-          if (!addstate(re, &nlist, mark, gen, ins.x, i + 1, subject_len, &steps, &limit)) break;
-        } else if (ins.op == I_CLASS) {
-          if (ins.cls < (uint16_t)re->class_len && bitset_test(re->classes[ins.cls].bits, b))
-            if (!addstate(re, &nlist, mark, gen, ins.x, i + 1, subject_len, &steps, &limit)) break;
-        }
-      }
+  sc->a.n = 0;
+  if (!dc_re_closure(re, &sc->a, sc->mark, gen, re->start_pc, subject_len == 0, &steps)) {
+    *limit = true;
+    return false;
+  }
+  if (dc_re_list_has_match(re, &sc->a)) return true;
+  return dc_re_nfa_run(re, sc, subject, subject_len, 0, steps, limit);
+}
 
-      if (limit) break;
-      gen++;
-      slist_t tmp = clist; clist = nlist; nlist = tmp;
-      if (list_has_match(re, &clist)) { slist_free(&clist); slist_free(&nlist); free(mark); return true; }
-      if (clist.n == 0) break;
-    }
-  } else {
-    for (size_t i = 0; i < subject_len; i++) {
-      slist_reset(&nlist);
+bool dc_regex_match_line_ctx(const dc_regex_t *re,
+                             dc_regex_ctx_t *ctx,
+                             const uint8_t *subject,
+                             size_t subject_len,
+                             bool *exec_limit_exceeded) {
+  if (exec_limit_exceeded) *exec_limit_exceeded = false;
+  if (!re || !ctx) return false;
 
-      for (int si = 0; si < clist.n; si++) {
-        int pc = clist.pcs[si];
+  if (dc_re_prefilter_rejects(re, subject, subject_len)) return false;
 
-        steps++;
-        if (steps > DC_REGEX_MAX_STEPS) { limit = true; break; }
+  bool limit = false;
+  bool matched;
+  if (re->set) matched = dc_re_set_match(re, ctx, subject, subject_len, &limit);
+  else if (re->bitpar && subject_len <= re->safe_len) matched = dc_re_bitpar_match(re, subject, subject_len);
+  else if (ctx->dfa && subject_len > 0) matched = dc_re_dfa_match(re, ctx->dfa, &ctx->sc, subject, subject_len, &limit);
+  else matched = nfa_match(re, &ctx->sc, subject, subject_len, &limit);
 
-        inst_t ins = re->prog[pc];
-        uint8_t b = subject[i];
+  if (exec_limit_exceeded) *exec_limit_exceeded = limit;
+  return matched && !limit;
+}
 
-        if (ins.op == I_CHAR) {
-          if (ins.c == b) if (!addstate(re, &nlist, mark, gen, ins.x, i + 1, subject_len, &steps, &limit)) break;
-        } else if (ins.op == I_ANY) {
-          if (!addstate(re, &nlist, mark, gen, ins.x, i + 1, subject_len, &steps, &limit)) break;
-        } else if (ins.op == I_CLASS) {
-          if (ins.cls < (uint16_t)re->class_len && bitset_test(re->classes[ins.cls].bits, b))
-            if (!addstate(re, &nlist, mark, gen, ins.x, i + 1, subject_len, &steps, &limit)) break;
-        }
-      }
+bool dc_regex_match_line(const dc_regex_t *re,
+                         const uint8_t *subject,
+                         size_t subject_len,
+                         bool *exec_limit_exceeded) {
+  if (exec_limit_exceeded) *exec_limit_exceeded = false;
+  if (!re) return false;
+  return dc_regex_match_line_ctx(re, re->ctx, subject, subject_len, exec_limit_exceeded);
+}
+
+/* First line start in [p, end) whose line is longer than SAFE bytes, or END
+ * if there is none. P and END are line starts (or END is the block end). */
+static size_t first_long_line(const uint8_t *block, size_t p, size_t end, size_t safe) {
+  while (end - p > safe) {
+    const uint8_t *nl = (const uint8_t *)memrchr(block + p, '\n', safe + 1);
+    if (!nl) return p;
+    p = (size_t)(nl - block) + 1;
+  }
+  return end;
+}
+
+bool dc_regex_find_line_ctx(const dc_regex_t *re,
+                            dc_regex_ctx_t *ctx,
+                            const uint8_t *block,
+                            size_t block_len,
+                            size_t *pos,
+                            size_t *line_off,
+                            size_t *line_len,
+                            bool *exec_limit_exceeded) {
+  if (exec_limit_exceeded) *exec_limit_exceeded = false;
+  if (!re || !ctx || !pos || !line_off || !line_len) return false;
+
+  /* A literal every match contains; for an anchored prefix a hit only
+   * marks a candidate line, which is then checked in full. */
+  const uint8_t *needle = NULL;
+  size_t nlen = 0;
+  if (re->lit_len > 0) { needle = re->lit; nlen = re->lit_len; }
+  else if (re->pre_len > 0) { needle = re->pre; nlen = re->pre_len; }
+
+  size_t p = *pos;
+
+  /* A set of plain literals is one automaton scan across the block. */
+  if (re->set && re->set->nsub == 0) {
+    size_t hit = re->set->ac ? dc_re_ac_find(re->set->ac, block, p, block_len) : block_len;
+    if (hit >= block_len) {
+      *pos = block_len;
+      return false;
+    }
+    const uint8_t *nl = (const uint8_t *)memrchr(block + p, '\n', hit - p);
+    size_t ls = nl ? (size_t)(nl - block) + 1 : p;
+    nl = (const uint8_t *)memchr(block + hit, '\n', block_len - hit);
+    size_t end = nl ? (size_t)(nl - block) + 1 : block_len;
+    *line_off = ls;
+    *line_len = end - ls;
+    *pos = end;
+    return true;
+  }
 
-      if (limit) break;
+  while (p < block_len) {
+    if (nlen > 0) {
+      const uint8_t *hit = (const uint8_t *)memmem(block + p, block_len - p, needle, nlen);
+      size_t ls = block_len;
+      if (hit) {
+        const uint8_t *nl = (const uint8_t *)memrchr(block + p, '\n', (size_t)(hit - block) - p);
+        ls = nl ? (size_t)(nl - block) + 1 : p;
+      }
+      /* Lines before LS lack the literal; only an overlong one among them
+       * still has to go through the VM for its limit check. */
+      p = first_long_line(block, p, ls, re->safe_len);
+      if (p >= block_len) break;
+    }
 
-      /* restart NFA at next position */
-      if (!addstate(re, &nlist, mark, gen, re->start_pc, i + 1, subject_len, &steps, &limit)) { /* may set limit */ }
-      if (limit) break;
+    const uint8_t *nl = (const uint8_t *)memchr(block + p, '\n', block_len - p);
+    size_t end = nl ? (size_t)(nl - block) + 1 : block_len;
+    size_t subj_len = nl ? end - p - 1 : end - p;
 
-      gen++;
-      slist_t tmp = clist; clist = nlist; nlist = tmp;
-      if (list_has_match(re, &clist)) { slist_free(&clist); slist_free(&nlist); free(mark); return true; }
+    bool limit = false;
+    bool matched = dc_regex_match_line_ctx(re, ctx, block + p, subj_len, &limit);
+    if (limit) {
+      if (exec_limit_exceeded) *exec_limit_exceeded = true;
+      *pos = p;
+      return false;
+    }
+    if (matched) {
+      *line_off = p;
+      *line_len = end - p;
+      *pos = end;
+      return true;
     }
+    p = end;
   }
 
-out:
-  slist_free(&clist);
-  slist_free(&nlist);
-  free(mark);
-  if (exec_limit_exceeded) *exec_limit_exceeded = limit;
+  *pos = block_len;
   return false;
 }
+
+bool dc_regex_find_line(const dc_regex_t *re,
+                        const uint8_t *block,
+                        size_t block_len,
+                        size_t *pos,
+                        size_t *line_off,
+                        size_t *line_len,
+                        bool *exec_limit_exceeded) {
+  if (exec_limit_exceeded) *exec_limit_exceeded = false;
+  if (!re) return false;
+  return dc_regex_find_line_ctx(re, re->ctx, block, block_len, pos, line_off, line_len, exec_limit_exceeded);
+}
@@ -0,0 +1,198 @@
+// regex_ac.c - Aho-Corasick automaton for sets of plain literals
+//
+// The trie is turned into a full DFA over byte classes (bytes that occur in
+// no literal share class 0), so a subject byte costs one class lookup and
+// one table load whatever the number of literals. Entries hold the target
+// row's offset, or -1 once some literal has been seen: match only needs to
+// know that a line contains one, so terminal states need no transitions.
+//
+// No literal contains '\n', so '\n' always leads back to the root and a
+// block of lines can be scanned in one pass.
+//
+// While the automaton sits at the root, no literal can start before the
+// next byte that begins one, so the scan jumps there with 64-byte masks
+// (simd_int.h): on the first byte of the literals, and when every literal
+// has two, also on the second byte at the following offset. Each
+// candidate is then confirmed by the automaton, as in Teddy.
+
+#include "regex_int.h"
+#include "simd_int.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+struct dc_re_ac {
+  int nclasses;
+  uint8_t byte_class[256];
+  bool root_out;   /* the empty literal: every subject contains it */
+  dc_byteset_t lead[2]; /* first and second bytes of the literals */
+  bool two;        /* every literal has a second byte */
+  int32_t nstates;
+  int32_t *next;   /* nstates x nclasses: target row offset, -1 = found */
+};
+
+typedef struct {
+  int32_t *go;     /* nstates x nclasses: child state, -1 if none */
+  uint8_t *term;
+  int32_t n;
+  int32_t cap;
+  int nc;
+} trie_t;
+
+static int32_t trie_add_state(trie_t *t) {
+  if (t->n == t->cap) {
+    int32_t nc = t->cap ? t->cap * 2 : 64;
+    if ((int64_t)nc * t->nc >= INT32_MAX) return -1;
+    int32_t *ng = (int32_t *)realloc(t->go, (size_t)nc * (size_t)t->nc * sizeof(int32_t));
+    if (!ng) return -1;
+    t->go = ng;
+    uint8_t *nt = (uint8_t *)realloc(t->term, (size_t)nc);
+    if (!nt) return -1;
+    t->term = nt;
+    t->cap = nc;
+  }
+  memset(t->go + (size_t)t->n * (size_t)t->nc, -1, (size_t)t->nc * sizeof(int32_t));
+  t->term[t->n] = 0;
+  return t->n++;
+}
+
+dc_re_ac_t *dc_re_ac_new(const uint8_t *const *lits, const size_t *lens, size_t n) {
+  dc_re_ac_t *ac = (dc_re_ac_t *)calloc(1, sizeof(*ac));
+  if (!ac) return NULL;
+
+  bool used[256] = { false };
+  uint8_t lead[2][32] = { { 0 } };
+  ac->two = true;
+  for (size_t i = 0; i < n; i++) {
+    if (memchr(lits[i], '\n', lens[i])) continue; /* matches no line */
+    if (lens[i] == 0) ac->root_out = true;
+    if (lens[i] < 2) ac->two = false;
+    for (size_t j = 0; j < lens[i]; j++) {
+      used[lits[i][j]] = true;
+      if (j < 2) lead[j][lits[i][j] >> 3] |= (uint8_t)(1u << (lits[i][j] & 7));
+    }
+  }
+  dc_byteset_init(&ac->lead[0], lead[0]);
+  dc_byteset_init(&ac->lead[1], lead[1]);
+  int nc = 1;
+  for (int b = 0; b < 256; b++) ac->byte_class[b] = used[b] ? (uint8_t)nc++ : 0;
+  ac->nclasses = nc;
+
+  trie_t t = { NULL, NULL, 0, 0, nc };
+  int32_t *fail = NULL;
+  int32_t *queue = NULL;
+  if (trie_add_state(&t) < 0) goto fail;
+
+  for (size_t i = 0; i < n; i++) {
+    if (memchr(lits[i], '\n', lens[i])) continue;
+    int32_t s = 0;
+    for (size_t j = 0; j < lens[i]; j++) {
+      size_t slot = (size_t)s * (size_t)nc + ac->byte_class[lits[i][j]];
+      if (t.go[slot] < 0) {
+        int32_t u = trie_add_state(&t);
+        if (u < 0) goto fail;
+        t.go[slot] = u;
+      }
+      s = t.go[slot];
+    }
+    t.term[s] = 1;
+  }
+
+  // Breadth-first: a state's failure target is shallower, so its row is
+  // complete by the time the state's own missing transitions copy it.
+  fail = (int32_t *)malloc((size_t)t.n * sizeof(int32_t));
+  queue = (int32_t *)malloc((size_t)t.n * sizeof(int32_t));
+  if (!fail || !queue) goto fail;
+  int32_t qh = 0, qt = 0;
+  for (int c = 0; c < nc; c++) {
+    int32_t u = t.go[c];
+    if (u < 0) {
+      t.go[c] = 0;
+    } else {
+      fail[u] = 0;
+      queue[qt++] = u;
+    }
+  }
+  while (qh < qt) {
+    int32_t s = queue[qh++];
+    int32_t *row = t.go + (size_t)s * (size_t)nc;
+    const int32_t *frow = t.go + (size_t)fail[s] * (size_t)nc;
+    for (int c = 0; c < nc; c++) {
+      int32_t u = row[c];
+      if (u < 0) {
+        row[c] = frow[c];
+      } else {
+        fail[u] = frow[c];
+        t.term[u] |= t.term[fail[u]];
+        queue[qt++] = u;
+      }
+    }
+  }
+
+  for (size_t k = 0; k < (size_t)t.n * (size_t)nc; k++) {
+    int32_t u = t.go[k];
+    t.go[k] = t.term[u] ? -1 : u * nc;
+  }
+  ac->nstates = t.n;
+  ac->next = t.go;
+  free(t.term);
+  free(fail);
+  free(queue);
+  return ac;
+
+fail:
+  free(t.go);
+  free(t.term);
+  free(fail);
+  free(queue);
+  free(ac);
+  return NULL;
+}
+
+void dc_re_ac_free(dc_re_ac_t *ac) {
+  if (!ac) return;
+  free(ac->next);
+  free(ac);
+}
+
+size_t dc_re_ac_mem_size(const dc_re_ac_t *ac) {
+  return ac ? sizeof(*ac) + (size_t)ac->nstates * (size_t)ac->nclasses * sizeof(int32_t) : 0;
+}
+
+/* The first offset in [I, LEN) where a literal may start, or LEN. */
+static size_t next_lead(const dc_re_ac_t *ac, const uint8_t *p, size_t i, size_t len,
+                        bool two, bool avx2) {
+  if (dc_byteset_has(&ac->lead[0], p[i])) {
+    if (!two || i + 1 >= len || dc_byteset_has(&ac->lead[1], p[i + 1])) return i;
+  }
+  /* The second-byte mask reads one byte past the block. */
+  for (size_t stop = two ? 65 : 64; i + stop <= len; i += 64) {
+    uint64_t m = dc_byteset_mask64(&ac->lead[0], p + i, avx2);
+    if (m && two) m &= dc_byteset_mask64(&ac->lead[1], p + i + 1, avx2);
+    if (m) return i + (size_t)__builtin_ctzll(m);
+  }
+  while (i < len && !dc_byteset_has(&ac->lead[0], p[i])) i++;
+  return i;
+}
+
+size_t dc_re_ac_find(const dc_re_ac_t *ac, const uint8_t *block, size_t from, size_t len) {
+  if (ac->root_out) return from;
+  const int32_t *next = ac->next;
+  bool avx2 = dc_simd_avx2();
+  bool scan = dc_byteset_vector(&ac->lead[0], avx2);
+  bool two = scan && ac->two && dc_byteset_vector(&ac->lead[1], avx2);
+  int32_t row = 0;
+  for (size_t i = from; i < len; i++) {
+    if (row == 0 && scan) {
+      i = next_lead(ac, block, i, len, two, avx2);
+      if (i == len) break;
+    }
+    row = next[row + ac->byte_class[block[i]]];
+    if (row < 0) return i;
+  }
+  return len;
+}
+
+bool dc_re_ac_match(const dc_re_ac_t *ac, const uint8_t *subject, size_t subject_len) {
+  return ac->root_out || dc_re_ac_find(ac, subject, 0, subject_len) < subject_len;
+}
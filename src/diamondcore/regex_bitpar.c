@@ -0,0 +1,174 @@
+// regex_bitpar.c - bit-parallel simulation of small programs
+//
+// The consuming instructions (CHAR, ANY, CLASS) are the positions of a
+// Glushkov automaton. With at most 64 of them, the Pike VM's thread list
+// is a set of positions that fits in one word, and a transition is: keep
+// the positions that accept the byte (one table lookup and an AND), then
+// map those to the positions their epsilon closures reach, eight positions
+// per table lookup. The VM orders its threads, but match only reports
+// whether a line matches, so the set is all that is needed.
+//
+// Neither steps nor active states are counted. Like the prefilter, the
+// engine only takes subjects of at most safe_len bytes, on which the VM
+// provably stays within its limits, so it never has a limit to report.
+
+#include "regex_int.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#define BP_MAX_POS 64
+
+struct dc_re_bitpar {
+  uint64_t accept[256]; /* positions that consume byte b */
+  uint64_t first;       /* positions in the closure of start_pc */
+  uint64_t acc_mid;     /* positions whose successor closure holds MATCH */
+  uint64_t acc_end;     /* ... when the subject ends after them ($ passes) */
+  bool first_acc_mid;
+  bool first_acc_end;
+  int nchunks;
+  uint64_t follow[];    /* NCHUNKS tables of 256: closure positions of the
+                         * positions set in one byte of the state word */
+};
+
+typedef struct {
+  const dc_regex_t *re;
+  const int *pos_of; /* pc -> position, -1 for epsilon instructions */
+  uint32_t *seen;
+  uint32_t gen;
+  int *stack;
+} walk_t;
+
+/* The positions and whether MATCH lie in the closure of PC, the way
+ * dc_re_closure walks it. */
+static uint64_t closure(walk_t *w, int pc, bool at_end, bool *match) {
+  const dc_regex_t *re = w->re;
+  uint64_t set = 0;
+  int sp = 0;
+  w->gen++;
+  *match = false;
+  w->stack[sp++] = pc;
+  while (sp > 0) {
+    int cpc = w->stack[--sp];
+    if (cpc < 0 || cpc >= re->prog_len || w->seen[cpc] == w->gen) continue;
+    w->seen[cpc] = w->gen;
+    const inst_t *ins = &re->prog[cpc];
+    switch (ins->op) {
+      case I_MATCH: *match = true; break;
+      case I_JMP:   w->stack[sp++] = ins->x; break;
+      case I_SPLIT: w->stack[sp++] = ins->x; w->stack[sp++] = ins->y; break;
+      case I_EOL:   if (at_end) w->stack[sp++] = ins->x; break;
+      default:      set |= (uint64_t)1 << w->pos_of[cpc]; break;
+    }
+  }
+  return set;
+}
+
+dc_re_bitpar_t *dc_re_bitpar_new(const dc_regex_t *re) {
+  if (!re || re->safe_len == 0) return NULL;
+
+  int npos = 0;
+  for (int pc = 0; pc < re->prog_len; pc++) {
+    uint8_t op = re->prog[pc].op;
+    if (op == I_CHAR || op == I_ANY || op == I_CLASS) npos++;
+  }
+  if (npos == 0 || npos > BP_MAX_POS) return NULL;
+
+  int nchunks = (npos + 7) / 8;
+  size_t sz = sizeof(dc_re_bitpar_t) + (size_t)nchunks * 256 * sizeof(uint64_t);
+  dc_re_bitpar_t *bp = (dc_re_bitpar_t *)calloc(1, sz);
+  int *pos_of = (int *)malloc((size_t)re->prog_len * sizeof(int));
+  int *pc_of = (int *)malloc((size_t)npos * sizeof(int));
+  uint32_t *seen = (uint32_t *)calloc((size_t)re->prog_len, sizeof(uint32_t));
+  int *stack = (int *)malloc(((size_t)re->prog_len * 2 + 1) * sizeof(int));
+  if (!bp || !pos_of || !pc_of || !seen || !stack) {
+    free(bp);
+    bp = NULL;
+    goto done;
+  }
+  bp->nchunks = nchunks;
+
+  int p = 0;
+  for (int pc = 0; pc < re->prog_len; pc++) {
+    const inst_t *ins = &re->prog[pc];
+    pos_of[pc] = -1;
+    if (ins->op != I_CHAR && ins->op != I_ANY && ins->op != I_CLASS) continue;
+    uint64_t bit = (uint64_t)1 << p;
+    for (int b = 0; b < 256; b++) {
+      bool in = ins->op == I_ANY ||
+                (ins->op == I_CHAR && ins->c == (uint8_t)b) ||
+                (ins->op == I_CLASS && ins->cls < (uint16_t)re->class_len &&
+                 dc_re_bitset_test(re->classes[ins->cls].bits, (uint8_t)b));
+      if (in) bp->accept[b] |= bit;
+    }
+    pos_of[pc] = p;
+    pc_of[p++] = pc;
+  }
+
+  walk_t w = { re, pos_of, seen, 0, stack };
+  bp->first = closure(&w, re->start_pc, false, &bp->first_acc_mid);
+  closure(&w, re->start_pc, true, &bp->first_acc_end);
+
+  uint64_t follow[BP_MAX_POS];
+  for (p = 0; p < npos; p++) {
+    bool m = false;
+    uint64_t bit = (uint64_t)1 << p;
+    follow[p] = closure(&w, re->prog[pc_of[p]].x, false, &m);
+    if (m) bp->acc_mid |= bit;
+    closure(&w, re->prog[pc_of[p]].x, true, &m);
+    if (m) bp->acc_end |= bit;
+  }
+
+  // Entry V of table K is the union of the follow sets of positions
+  // 8K + j for the bits j set in V.
+  for (int k = 0; k < nchunks; k++) {
+    uint64_t *tbl = bp->follow + (size_t)k * 256;
+    for (int v = 1; v < 256; v++) {
+      int j = __builtin_ctz((unsigned)v);
+      int pos = 8 * k + j;
+      tbl[v] = tbl[v & (v - 1)] | (pos < npos ? follow[pos] : 0);
+    }
+  }
+
+done:
+  free(pos_of);
+  free(pc_of);
+  free(seen);
+  free(stack);
+  return bp;
+}
+
+void dc_re_bitpar_free(dc_re_bitpar_t *bp) { free(bp); }
+
+size_t dc_re_bitpar_mem_size(const dc_re_bitpar_t *bp) {
+  return bp ? sizeof(*bp) + (size_t)bp->nchunks * 256 * sizeof(uint64_t) : 0;
+}
+
+bool dc_re_bitpar_match(const dc_regex_t *re, const uint8_t *subject, size_t subject_len) {
+  const dc_re_bitpar_t *bp = re->bitpar;
+  if (subject_len == 0) return bp->first_acc_end;
+  if (bp->first_acc_mid) return true;
+
+  /* Unanchored patterns restart after every byte; the restart reaching
+   * MATCH at the end is decided once, below. */
+  const uint64_t restart = re->anchor_start ? 0 : bp->first;
+  const int nchunks = bp->nchunks;
+  uint64_t s = bp->first;
+  size_t last = subject_len - 1;
+
+  for (size_t i = 0; i < last; i++) {
+    if (s == restart && re->first_skip) {
+      i = dc_re_skip_idle(re, subject, i, last); /* bytes that start nothing */
+      if (i == last) break;
+    }
+    uint64_t t = s & bp->accept[subject[i]];
+    if (t & bp->acc_mid) return true;
+    uint64_t next = restart;
+    for (int k = 0; k < nchunks; k++) next |= bp->follow[(size_t)k * 256 + ((t >> (8 * k)) & 0xff)];
+    s = next;
+    if (s == 0) return !re->anchor_start && bp->first_acc_end; /* no threads left */
+  }
+
+  uint64_t t = s & bp->accept[subject[last]];
+  return (t & bp->acc_end) != 0 || (!re->anchor_start && bp->first_acc_end);
+}
@@ -0,0 +1,169 @@
+// regex_cache.c - session cache of compiled patterns (LRU, byte budget)
+//
+// Entries are kept in most-recently-used order on a doubly linked list
+// and found through a chained hash table on the pattern bytes. A compiled
+// pattern takes a kilobyte or two, so the budget holds thousands of them.
+
+#include "regex_int.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#define CACHE_BUCKETS 1024 /* power of two */
+
+typedef struct cache_entry {
+  struct cache_entry *prev;
+  struct cache_entry *next;
+  struct cache_entry *chain; /* next in the hash bucket */
+  char *pattern;
+  size_t len;
+  uint32_t hash;
+  dc_regex_t *re;
+  size_t bytes; /* dc_re_mem_size as of the last put */
+  int refs;
+} cache_entry_t;
+
+static struct {
+  cache_entry_t *head; /* most recently used */
+  cache_entry_t *tail;
+  cache_entry_t *buckets[CACHE_BUCKETS];
+  size_t entries;
+  size_t bytes;
+  uint64_t hits;
+  uint64_t misses;
+  uint64_t evictions;
+} cache;
+
+static uint32_t hash_bytes(const char *p, size_t n) {
+  uint32_t h = 2166136261u;
+  for (size_t i = 0; i < n; i++) {
+    h ^= (uint8_t)p[i];
+    h *= 16777619u;
+  }
+  return h;
+}
+
+static void unlink_entry(cache_entry_t *e) {
+  if (e->prev) e->prev->next = e->next;
+  else cache.head = e->next;
+  if (e->next) e->next->prev = e->prev;
+  else cache.tail = e->prev;
+  e->prev = e->next = NULL;
+}
+
+static void push_front(cache_entry_t *e) {
+  e->prev = NULL;
+  e->next = cache.head;
+  if (cache.head) cache.head->prev = e;
+  cache.head = e;
+  if (!cache.tail) cache.tail = e;
+}
+
+static void drop_entry(cache_entry_t *e) {
+  cache_entry_t **pp = &cache.buckets[e->hash & (CACHE_BUCKETS - 1)];
+  while (*pp != e) pp = &(*pp)->chain;
+  *pp = e->chain;
+  e->re->cache_entry = NULL;
+  unlink_entry(e);
+  cache.entries--;
+  cache.bytes -= e->bytes;
+  dc_regex_free(e->re);
+  free(e->pattern);
+  free(e);
+}
+
+/* Free idle entries, least recently used first, until within budget. */
+static void evict(void) {
+  cache_entry_t *e = cache.tail;
+  while (e && cache.bytes > DC_REGEX_CACHE_BUDGET) {
+    cache_entry_t *prev = e->prev;
+    if (e->refs == 0) {
+      drop_entry(e);
+      cache.evictions++;
+    }
+    e = prev;
+  }
+}
+
+bool dc_regex_cache_get(dc_regex_t **out_re, const char *pattern, char errbuf[256]) {
+  if (errbuf) errbuf[0] = '\0';
+  if (!out_re || !pattern) return false;
+
+  size_t len = strlen(pattern);
+  uint32_t h = hash_bytes(pattern, len);
+  cache_entry_t **bucket = &cache.buckets[h & (CACHE_BUCKETS - 1)];
+  for (cache_entry_t *e = *bucket; e; e = e->chain) {
+    if (e->hash == h && e->len == len && memcmp(e->pattern, pattern, len) == 0) {
+      unlink_entry(e);
+      push_front(e);
+      e->refs++;
+      cache.hits++;
+      *out_re = e->re;
+      return true;
+    }
+  }
+
+  cache.misses++;
+  dc_regex_t *re = NULL;
+  if (!dc_regex_compile(&re, pattern, errbuf)) return false;
+  *out_re = re;
+
+  // Without memory for an entry the pattern is simply not cached;
+  // dc_regex_cache_put then frees it.
+  cache_entry_t *e = (cache_entry_t *)calloc(1, sizeof(*e));
+  char *copy = (char *)malloc(len + 1);
+  if (!e || !copy) {
+    free(e);
+    free(copy);
+    return true;
+  }
+  memcpy(copy, pattern, len + 1);
+  e->pattern = copy;
+  e->len = len;
+  e->hash = h;
+  e->re = re;
+  e->bytes = dc_re_mem_size(re);
+  e->refs = 1;
+  e->chain = *bucket;
+  *bucket = e;
+  re->cache_entry = e;
+  push_front(e);
+  cache.entries++;
+  cache.bytes += e->bytes;
+  evict();
+  return true;
+}
+
+void dc_regex_cache_put(dc_regex_t *re) {
+  if (!re) return;
+  cache_entry_t *e = (cache_entry_t *)re->cache_entry;
+  if (!e) {
+    dc_regex_free(re);
+    return;
+  }
+  if (e->refs > 0) e->refs--;
+  // The lazy DFA may have grown while the pattern was in use.
+  size_t bytes = dc_re_mem_size(re);
+  cache.bytes = cache.bytes - e->bytes + bytes;
+  e->bytes = bytes;
+  evict();
+}
+
+void dc_regex_cache_stats(dc_regex_cache_stats_t *st) {
+  if (!st) return;
+  st->entries = cache.entries;
+  st->bytes = cache.bytes;
+  st->hits = cache.hits;
+  st->misses = cache.misses;
+  st->evictions = cache.evictions;
+}
+
+void dc_regex_cache_clear(void) {
+  cache_entry_t *e = cache.head;
+  while (e) {
+    cache_entry_t *next = e->next;
+    if (e->refs == 0) drop_entry(e);
+    e = next;
+  }
+  cache.hits = cache.misses = cache.evictions = 0;
+}
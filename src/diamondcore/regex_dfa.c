@@ -0,0 +1,335 @@
+// regex_dfa.c - lazy DFA over Pike VM thread lists
+//
+// A DFA state is the ordered thread list the VM would hold at some subject
+// position. Transitions are computed on demand by running one VM step and
+// are cached together with the number of states that step processed, so a
+// cached walk charges the per-line transition budget exactly like the VM.
+//
+// Bytes that every instruction treats alike share one transition slot
+// (byte classes), which keeps a state to a few dozen slots for typical
+// patterns. In the start state of an unanchored search, bytes that begin
+// no match are skipped in one scan and charged the start state's idle
+// cost each.
+//
+// The cache has a fixed memory budget. When it fills up, the rest of that
+// line runs on the VM, the cache is emptied before the next line, and
+// after too many such resets the DFA is switched off for the pattern.
+
+#include "regex_int.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+/* Memory for cached states (lists plus transition slots). */
+#define DFA_MEM_BUDGET   ((size_t)1 << 20)
+#define DFA_MAX_STATES   4096
+#define DFA_MIN_TABLE    32 /* power of two; kept at least twice nstates */
+#define DFA_MAX_RESETS   8
+
+#define DFA_UNKNOWN  (-1)
+#define DFA_OVERFLOW (-2) /* the VM step hits the active-state limit */
+#define DFA_FULL     (-3) /* no room left in the cache */
+
+typedef struct {
+  int32_t *next;   /* per byte class: state index, DFA_UNKNOWN or DFA_OVERFLOW */
+  uint32_t *cost;  /* per byte class: VM steps charged for the transition */
+  int *pcs;
+  int n;
+  bool has_match;
+  uint32_t hash;
+} dstate_t;
+
+struct dc_dfa {
+  int nclasses;
+  uint8_t byte_class[256];
+  uint8_t class_rep[256]; /* one representative byte per class */
+
+  dstate_t **states;     /* grown with the table, up to DFA_MAX_STATES */
+  int nstates;
+  int32_t *table;        /* open addressing: state index or -1 */
+  size_t table_size;
+  size_t mem_used;       /* states only; counted against DFA_MEM_BUDGET */
+
+  int start;            /* state at offset 0 of a non-empty subject, -1 if unbuilt */
+  uint32_t start_cost;
+  uint32_t idle_cost;   /* start's transition on a byte that begins no match */
+
+  bool full;            /* budget ran out; reset before the next subject */
+  int resets;
+  bool disabled;
+};
+
+/* Split byte classes so that every CHAR/CLASS instruction sees each class
+ * as either wholly accepted or wholly rejected. */
+static void build_byte_classes(const dc_regex_t *re, dc_dfa_t *dfa) {
+  int cls[256] = { 0 };
+  int n = 1;
+
+  for (int pc = 0; pc < re->prog_len; pc++) {
+    const inst_t *ins = &re->prog[pc];
+    if (ins->op != I_CHAR && ins->op != I_CLASS) continue;
+
+    int remap[256];
+    for (int i = 0; i < n; i++) remap[i] = -1;
+    int m = n;
+    for (int b = 0; b < 256; b++) {
+      bool in = (ins->op == I_CHAR)
+                  ? (ins->c == (uint8_t)b)
+                  : (ins->cls < (uint16_t)re->class_len && dc_re_bitset_test(re->classes[ins->cls].bits, (uint8_t)b));
+      if (!in) continue;
+      int old = cls[b];
+      if (remap[old] < 0) remap[old] = m++;
+      cls[b] = remap[old];
+    }
+
+    /* Renumber densely; classes wholly inside the set left gaps. */
+    int dense[512];
+    for (int i = 0; i < m; i++) dense[i] = -1;
+    n = 0;
+    for (int b = 0; b < 256; b++) {
+      if (dense[cls[b]] < 0) dense[cls[b]] = n++;
+      cls[b] = dense[cls[b]];
+    }
+  }
+
+  dfa->nclasses = n;
+  for (int b = 0; b < 256; b++) dfa->byte_class[b] = (uint8_t)cls[b];
+  for (int b = 255; b >= 0; b--) dfa->class_rep[cls[b]] = (uint8_t)b;
+}
+
+dc_dfa_t *dc_re_dfa_new(const dc_regex_t *re) {
+  if (!re) return NULL;
+  dc_dfa_t *dfa = (dc_dfa_t *)calloc(1, sizeof(dc_dfa_t));
+  if (!dfa) return NULL;
+  dfa->table_size = DFA_MIN_TABLE;
+  dfa->states = (dstate_t **)malloc(DFA_MIN_TABLE / 2 * sizeof(dstate_t *));
+  dfa->table = (int32_t *)malloc(DFA_MIN_TABLE * sizeof(int32_t));
+  if (!dfa->states || !dfa->table) {
+    free(dfa->states);
+    free(dfa->table);
+    free(dfa);
+    return NULL;
+  }
+  build_byte_classes(re, dfa);
+  memset(dfa->table, -1, dfa->table_size * sizeof(int32_t));
+  dfa->start = -1;
+  return dfa;
+}
+
+static void dfa_reset(dc_dfa_t *dfa) {
+  for (int i = 0; i < dfa->nstates; i++) free(dfa->states[i]);
+  dfa->nstates = 0;
+  dfa->mem_used = 0;
+  memset(dfa->table, -1, dfa->table_size * sizeof(int32_t));
+  dfa->start = -1;
+  dfa->full = false;
+}
+
+void dc_re_dfa_free(dc_dfa_t *dfa) {
+  if (!dfa) return;
+  dfa_reset(dfa);
+  free(dfa->states);
+  free(dfa->table);
+  free(dfa);
+}
+
+size_t dc_re_dfa_mem_size(const dc_dfa_t *dfa) {
+  if (!dfa) return 0;
+  return sizeof(*dfa) + dfa->mem_used +
+         dfa->table_size * (sizeof(int32_t) + sizeof(dstate_t *) / 2);
+}
+
+static uint32_t hash_list(const int *pcs, int n) {
+  uint32_t h = 2166136261u;
+  for (int i = 0; i < n; i++) {
+    h ^= (uint32_t)pcs[i];
+    h *= 16777619u;
+  }
+  return h;
+}
+
+/* Double the table (and the state array, which is half its size) and
+ * rehash. */
+static bool dfa_grow(dc_dfa_t *dfa) {
+  size_t nsize = dfa->table_size * 2;
+  dstate_t **ns = (dstate_t **)realloc(dfa->states, nsize / 2 * sizeof(dstate_t *));
+  if (!ns) return false;
+  dfa->states = ns;
+  int32_t *nt = (int32_t *)malloc(nsize * sizeof(int32_t));
+  if (!nt) return false;
+  memset(nt, -1, nsize * sizeof(int32_t));
+  for (int32_t si = 0; si < dfa->nstates; si++) {
+    size_t slot = dfa->states[si]->hash & (nsize - 1);
+    while (nt[slot] >= 0) slot = (slot + 1) & (nsize - 1);
+    nt[slot] = si;
+  }
+  free(dfa->table);
+  dfa->table = nt;
+  dfa->table_size = nsize;
+  return true;
+}
+
+/* Find the state for thread list SL or add it. Returns DFA_FULL when the
+ * cache has no room left. */
+static int32_t dfa_intern(const dc_regex_t *re, dc_dfa_t *dfa, const slist_t *sl) {
+  uint32_t h = hash_list(sl->pcs, sl->n);
+  size_t mask = dfa->table_size - 1;
+  size_t slot = h & mask;
+  for (;;) {
+    int32_t si = dfa->table[slot];
+    if (si < 0) break;
+    const dstate_t *st = dfa->states[si];
+    if (st->hash == h && st->n == sl->n &&
+        memcmp(st->pcs, sl->pcs, (size_t)sl->n * sizeof(int)) == 0) {
+      return si;
+    }
+    slot = (slot + 1) & mask;
+  }
+
+  size_t nc = (size_t)dfa->nclasses;
+  size_t sz = sizeof(dstate_t) + nc * (sizeof(int32_t) + sizeof(uint32_t)) + (size_t)sl->n * sizeof(int);
+  if (dfa->nstates >= DFA_MAX_STATES || dfa->mem_used + sz > DFA_MEM_BUDGET) {
+    dfa->full = true;
+    return DFA_FULL;
+  }
+
+  if ((size_t)dfa->nstates * 2 >= dfa->table_size) {
+    if (!dfa_grow(dfa)) {
+      dfa->full = true;
+      return DFA_FULL;
+    }
+    slot = h & (dfa->table_size - 1);
+    while (dfa->table[slot] >= 0) slot = (slot + 1) & (dfa->table_size - 1);
+  }
+
+  dstate_t *st = (dstate_t *)malloc(sz);
+  if (!st) {
+    dfa->full = true;
+    return DFA_FULL;
+  }
+  st->next = (int32_t *)(st + 1);
+  st->cost = (uint32_t *)(st->next + nc);
+  st->pcs = (int *)(st->cost + nc);
+  for (size_t c = 0; c < nc; c++) { st->next[c] = DFA_UNKNOWN; st->cost[c] = 0; }
+  memcpy(st->pcs, sl->pcs, (size_t)sl->n * sizeof(int));
+  st->n = sl->n;
+  st->has_match = dc_re_list_has_match(re, sl);
+  st->hash = h;
+
+  int32_t si = dfa->nstates++;
+  dfa->states[si] = st;
+  dfa->table[slot] = si;
+  dfa->mem_used += sz;
+  return si;
+}
+
+static void load_list(dc_re_scratch_t *sc, const dstate_t *st) {
+  memcpy(sc->a.pcs, st->pcs, (size_t)st->n * sizeof(int));
+  sc->a.n = st->n;
+}
+
+/* Compute and cache the transition of state SI on byte class C. */
+static int32_t dfa_build(const dc_regex_t *re, dc_dfa_t *dfa, dc_re_scratch_t *sc, int32_t si, int c) {
+  dstate_t *st = dfa->states[si];
+  load_list(sc, st);
+  sc->b.n = 0;
+
+  uint64_t cost = 0;
+  uint32_t gen = dc_re_next_gen(sc, re->prog_len);
+  if (!dc_re_step(re, &sc->a, dfa->class_rep[c], false, &sc->b, sc->mark, gen, &cost)) {
+    st->next[c] = DFA_OVERFLOW;
+    return DFA_OVERFLOW;
+  }
+
+  int32_t ni = dfa_intern(re, dfa, &sc->b);
+  if (ni < 0) return ni;
+  st->next[c] = ni;
+  st->cost[c] = (uint32_t)cost;
+  return ni;
+}
+
+static int32_t dfa_start(const dc_regex_t *re, dc_dfa_t *dfa, dc_re_scratch_t *sc) {
+  if (dfa->start >= 0) return dfa->start;
+
+  sc->a.n = 0;
+  uint64_t cost = 0;
+  uint32_t gen = dc_re_next_gen(sc, re->prog_len);
+  if (!dc_re_closure(re, &sc->a, sc->mark, gen, re->start_pc, false, &cost)) return DFA_OVERFLOW;
+
+  int32_t si = dfa_intern(re, dfa, &sc->a);
+  if (si < 0) return si;
+  dfa->start = si;
+  dfa->start_cost = (uint32_t)cost;
+  /* Each thread is tried once, then the restart rebuilds the same list. */
+  dfa->idle_cost = (uint32_t)cost + (uint32_t)sc->a.n;
+  return si;
+}
+
+bool dc_re_dfa_match(const dc_regex_t *re, dc_dfa_t *dfa, dc_re_scratch_t *sc,
+                     const uint8_t *subject, size_t subject_len, bool *limit) {
+  /* Callers route empty subjects to the VM: offset 0 is also the end there. */
+  if (dfa->full) {
+    dfa_reset(dfa);
+    if (++dfa->resets > DFA_MAX_RESETS) dfa->disabled = true;
+  }
+
+  size_t i = 0;
+  uint64_t steps = 0;
+
+  int32_t si = dfa->disabled ? DFA_FULL : dfa_start(re, dfa, sc);
+  if (si == DFA_OVERFLOW) { *limit = true; return false; }
+  if (si == DFA_FULL) {
+    /* No DFA available: run the VM from scratch. */
+    sc->a.n = 0;
+    uint32_t gen = dc_re_next_gen(sc, re->prog_len);
+    if (!dc_re_closure(re, &sc->a, sc->mark, gen, re->start_pc, false, &steps)) {
+      *limit = true;
+      return false;
+    }
+    if (dc_re_list_has_match(re, &sc->a)) return true;
+    return dc_re_nfa_run(re, sc, subject, subject_len, 0, steps, limit);
+  }
+
+  steps = dfa->start_cost;
+  const dstate_t *st = dfa->states[si];
+  if (st->has_match) return true;
+
+  /* With I_EOL in the program the last byte steps with at_end set; that one
+   * transition is left to the VM. */
+  size_t cached_len = re->has_eol ? subject_len - 1 : subject_len;
+
+  for (; i < cached_len; i++) {
+    if (si == dfa->start && re->first_skip) {
+      size_t j = dc_re_skip_idle(re, subject, i, cached_len);
+      steps += (uint64_t)(j - i) * dfa->idle_cost;
+      if (steps > DC_REGEX_MAX_STEPS) { *limit = true; return false; }
+      i = j;
+      if (i == cached_len) break;
+    }
+
+    int c = dfa->byte_class[subject[i]];
+    int32_t ni = st->next[c];
+    if (ni < 0) {
+      if (ni == DFA_UNKNOWN) ni = dfa_build(re, dfa, sc, si, c);
+      if (ni == DFA_OVERFLOW) { *limit = true; return false; }
+      if (ni == DFA_FULL) {
+        load_list(sc, st);
+        return dc_re_nfa_run(re, sc, subject, subject_len, i, steps, limit);
+      }
+    }
+
+    steps += st->cost[c];
+    if (steps > DC_REGEX_MAX_STEPS) { *limit = true; return false; }
+
+    si = ni;
+    st = dfa->states[si];
+    if (st->has_match) return true;
+    if (re->anchor_start && st->n == 0) return false;
+  }
+
+  if (i < subject_len) {
+    load_list(sc, st);
+    return dc_re_nfa_run(re, sc, subject, subject_len, i, steps, limit);
+  }
+  return false;
+}
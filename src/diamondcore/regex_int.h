@@ -0,0 +1,214 @@
+// regex_int.h - internals shared by the dc_regex engines
+
+#ifndef DC_REGEX_INT_H
+#define DC_REGEX_INT_H
+
+#include "dc_regex.h"
+#include "simd_int.h"
+
+#include <string.h>
+
+typedef enum {
+  I_MATCH = 0,
+  I_CHAR,
+  I_ANY,
+  I_CLASS,
+  I_JMP,
+  I_SPLIT,
+  I_EOL
+} op_t;
+
+/* Eight bytes, so a typical program spans a few cache lines: branch
+ * targets fit in 16 bits because the program is capped at
+ * DC_REGEX_MAX_PROG_INSN instructions. */
+typedef struct {
+  uint8_t op; /* op_t */
+  uint8_t c;
+  uint16_t cls;
+  int16_t x;
+  int16_t y;
+} inst_t;
+
+_Static_assert(DC_REGEX_MAX_PROG_INSN <= INT16_MAX, "inst_t branch targets are 16-bit");
+
+typedef struct {
+  uint8_t bits[32]; /* 256-bit */
+} cls_t;
+
+typedef struct dc_dfa dc_dfa_t;
+typedef struct dc_re_bitpar dc_re_bitpar_t;
+typedef struct dc_re_ac dc_re_ac_t;
+
+/* A pattern set (regex_set.c): the plain literals' automaton and the
+ * other patterns, combined into alternations of at most this many
+ * instructions. A combined alternation is followed in SUB by its SPAN
+ * members, each compiled on its own, which are only run when the
+ * alternation hits a limit. */
+#define DC_RE_SET_GROUP_INSN 4096
+
+typedef struct {
+  dc_re_ac_t *ac;    /* NULL without literals */
+  dc_regex_t **sub;
+  size_t *span;      /* per SUB entry: members that follow it */
+  size_t nsub;
+} dc_re_set_t;
+
+#define DC_RE_LIT_MAX 32
+
+struct dc_regex {
+  inst_t *prog;
+  int prog_len;
+
+  cls_t *classes;
+  int class_len;
+
+  int start_pc;
+
+  bool anchor_start;
+  bool anchor_end;
+  bool has_eol;     /* program contains I_EOL: the last byte of a subject steps differently */
+
+  /* Prefilter (regex_prefilter.c); only valid for subjects of at most
+   * safe_len bytes, where the VM provably stays within its limits. */
+  size_t safe_len;
+  uint8_t pre[DC_RE_LIT_MAX]; /* anchored literal prefix */
+  size_t pre_len;
+  uint8_t lit[DC_RE_LIT_MAX]; /* literal every match contains */
+  size_t lit_len;
+  size_t min_len;             /* bytes every match consumes */
+
+  /* Bytes that can begin a match of an unanchored pattern. A search with
+   * no live threads skips to the next of them (dc_re_skip_idle). */
+  bool first_skip;
+  dc_byteset_t first;
+
+  dc_re_bitpar_t *bitpar; /* bit-parallel engine, NULL if the program is too big */
+
+  dc_re_set_t *set;    /* non-NULL: a pattern set, with no program of its own */
+
+  dc_regex_ctx_t *ctx; /* scratch used by dc_regex_match_line */
+  void *cache_entry;   /* regex_cache.c entry holding RE, NULL if uncached */
+};
+
+static inline bool dc_re_bitset_test(const uint8_t bits[32], uint8_t b) {
+  return (bits[b >> 3] & (uint8_t)(1u << (b & 7))) != 0;
+}
+
+/* Ordered NFA thread list (pcs of consuming or MATCH instructions). */
+typedef struct {
+  int *pcs;
+  int n;
+  int cap;
+} slist_t;
+
+bool dc_re_slist_init(slist_t *sl, int cap);
+void dc_re_slist_free(slist_t *sl);
+
+/* Pike VM primitives (regex.c).
+ *
+ * Every processed state adds one to *steps, exactly as the per-line
+ * transition budget in docs/match.md counts them; callers compare the
+ * running total against DC_REGEX_MAX_STEPS after each call. A false return
+ * means the active-state limit was hit (an execution limit error).
+ *
+ * MARK has prog_len entries; GEN must be fresh for each subject position.
+ */
+bool dc_re_closure(const dc_regex_t *re, slist_t *dst, uint32_t *mark, uint32_t gen,
+                   int pc, bool at_end, uint64_t *steps);
+
+/* One transition: consume B from CLIST into NLIST (appended), then restart
+ * the search at the next position unless the pattern is anchored. AT_END is
+ * true when the position after B is the end of the subject. */
+bool dc_re_step(const dc_regex_t *re, const slist_t *clist, uint8_t b, bool at_end,
+                slist_t *nlist, uint32_t *mark, uint32_t gen, uint64_t *steps);
+
+bool dc_re_list_has_match(const dc_regex_t *re, const slist_t *sl);
+
+/* Scratch for the Pike VM: two thread lists and the mark array. */
+typedef struct {
+  slist_t a;
+  slist_t b;
+  uint32_t *mark;
+  uint32_t gen;
+} dc_re_scratch_t;
+
+bool dc_re_scratch_init(dc_re_scratch_t *sc, int prog_len);
+void dc_re_scratch_free(dc_re_scratch_t *sc);
+uint32_t dc_re_next_gen(dc_re_scratch_t *sc, int prog_len);
+
+/* Run the Pike VM from position POS with the current thread list in SC->a,
+ * STEPS already spent on this subject. */
+bool dc_re_nfa_run(const dc_regex_t *re, dc_re_scratch_t *sc,
+                   const uint8_t *subject, size_t subject_len, size_t pos,
+                   uint64_t steps, bool *limit);
+
+/* Lazy DFA (regex_dfa.c). States are memoized Pike VM thread lists, so
+ * results and step accounting are identical to the VM. SC is the VM
+ * scratch of the owning context, used to build transitions. */
+dc_dfa_t *dc_re_dfa_new(const dc_regex_t *re);
+void dc_re_dfa_free(dc_dfa_t *dfa);
+bool dc_re_dfa_match(const dc_regex_t *re, dc_dfa_t *dfa, dc_re_scratch_t *sc,
+                     const uint8_t *subject, size_t subject_len, bool *limit);
+
+/* Heap bytes held by RE including its own context, and by DFA; the DFA
+ * part changes as states are cached. */
+size_t dc_re_mem_size(const dc_regex_t *re);
+size_t dc_re_dfa_mem_size(const dc_dfa_t *dfa);
+
+/* Bit-parallel engine for programs of at most 64 consuming instructions
+ * (regex_bitpar.c). Built after the prefilter; only valid for subjects of
+ * at most safe_len bytes, and read-only, so threads may share it. */
+dc_re_bitpar_t *dc_re_bitpar_new(const dc_regex_t *re);
+void dc_re_bitpar_free(dc_re_bitpar_t *bp);
+size_t dc_re_bitpar_mem_size(const dc_re_bitpar_t *bp);
+bool dc_re_bitpar_match(const dc_regex_t *re, const uint8_t *subject, size_t subject_len);
+
+/* Aho-Corasick automaton over LITS (regex_ac.c); literals containing
+ * '\n' are dropped, as they match no line. NULL when out of memory. */
+dc_re_ac_t *dc_re_ac_new(const uint8_t *const *lits, const size_t *lens, size_t n);
+void dc_re_ac_free(dc_re_ac_t *ac);
+size_t dc_re_ac_mem_size(const dc_re_ac_t *ac);
+bool dc_re_ac_match(const dc_re_ac_t *ac, const uint8_t *subject, size_t subject_len);
+
+/* Scan BLOCK from line start FROM; the offset of a byte in the first line
+ * containing a literal, or LEN if there is none. */
+size_t dc_re_ac_find(const dc_re_ac_t *ac, const uint8_t *block, size_t from, size_t len);
+
+void dc_re_set_free(dc_re_set_t *set);
+size_t dc_re_set_mem_size(const dc_re_set_t *set);
+bool dc_re_set_match(const dc_regex_t *re, dc_regex_ctx_t *ctx,
+                     const uint8_t *subject, size_t subject_len, bool *limit);
+
+/* The ^ / $ anchors of a whole pattern; the body is [*START, *END). */
+void dc_re_split_anchors(const char *pat, size_t len, bool *bol, bool *eol, size_t *start, size_t *end);
+
+/* Required-literal prefilter (regex_prefilter.c). */
+void dc_re_prefilter_init(dc_regex_t *re);
+
+/* Offset of the first byte in [I, END) of SUBJECT that can begin a match,
+ * or END; only for patterns with first_skip set. */
+size_t dc_re_skip_idle(const dc_regex_t *re, const uint8_t *subject, size_t i, size_t end);
+
+/* True when SUBJECT provably does not match and the VM could not have hit
+ * an execution limit on it. */
+static inline bool dc_re_prefilter_rejects(const dc_regex_t *re, const uint8_t *subject, size_t subject_len) {
+  if (subject_len > re->safe_len) return false;
+  if (subject_len < re->min_len) return true;
+  if (re->pre_len > 0 &&
+      (subject_len < re->pre_len || memcmp(subject, re->pre, re->pre_len) != 0)) {
+    return true;
+  }
+  if (re->lit_len == 1) return memchr(subject, re->lit[0], subject_len) == NULL;
+  if (re->lit_len > 1) return memmem(subject, subject_len, re->lit, re->lit_len) == NULL;
+  return false;
+}
+
+/* Match context: everything a match mutates. */
+struct dc_regex_ctx {
+  dc_re_scratch_t sc;
+  dc_dfa_t *dfa;    /* lazy DFA cache; NULL => Pike VM only */
+  dc_regex_ctx_t **sub; /* pattern set: one context per sub-pattern */
+  size_t nsub;
+};
+
+#endif /* DC_REGEX_INT_H */
@@ -0,0 +1,251 @@
+// regex_par.c - multi-threaded block scan with ordered output
+//
+// The block is cut into chunks at line boundaries. Worker threads claim
+// chunks in order, scan them with dc_regex_find_line_ctx on a private match
+// context and record the matching lines as byte ranges. The calling thread
+// hands the ranges to EMIT strictly in chunk order, so the output is the
+// same as a serial scan. At most PAR_WINDOW_PER_THREAD chunks per thread
+// may be finished but not yet emitted, which bounds memory on huge inputs.
+
+#include "regex_int.h"
+
+#include <pthread.h>
+#include <signal.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define PAR_CHUNK_SIZE        ((size_t)1 << 20)
+#define PAR_WINDOW_PER_THREAD 4
+#define PAR_MAX_THREADS       256
+
+typedef struct {
+  size_t off;
+  size_t len;
+} range_t;
+
+typedef struct {
+  range_t *r;
+  size_t n;
+  size_t cap;
+  bool limit;   /* chunk stopped at a line over the execution limit */
+  bool failed;  /* out of memory while recording ranges */
+  bool ready;
+} slot_t;
+
+typedef struct {
+  const dc_regex_t *re;
+  const uint8_t *block;
+  size_t len;
+  size_t nchunks;
+
+  slot_t *slots;
+  size_t nslots;
+
+  pthread_mutex_t mu;
+  pthread_cond_t ready_cv;  /* a slot became ready */
+  pthread_cond_t space_cv;  /* the collector released a slot */
+  size_t next;              /* next chunk to claim */
+  size_t emitted;           /* chunks handed to EMIT so far */
+  size_t stop_after;        /* chunks beyond this one are not needed */
+} par_t;
+
+typedef struct {
+  par_t *p;
+  dc_regex_ctx_t *ctx;
+  pthread_t tid;
+  bool started;
+} worker_t;
+
+/* Offset of the first line starting at or after chunk I's nominal start. */
+static size_t chunk_start(const par_t *p, size_t i) {
+  if (i == 0) return 0;
+  size_t at = i * PAR_CHUNK_SIZE;
+  if (at >= p->len) return p->len;
+  const uint8_t *nl = (const uint8_t *)memchr(p->block + at - 1, '\n', p->len - at + 1);
+  return nl ? (size_t)(nl - p->block) + 1 : p->len;
+}
+
+static bool slot_push(slot_t *s, size_t off, size_t len) {
+  if (s->n > 0 && s->r[s->n - 1].off + s->r[s->n - 1].len == off) {
+    s->r[s->n - 1].len += len; /* adjacent matching lines form one range */
+    return true;
+  }
+  if (s->n == s->cap) {
+    size_t ncap = s->cap ? s->cap * 2 : 64;
+    range_t *nr = (range_t *)realloc(s->r, ncap * sizeof(range_t));
+    if (!nr) return false;
+    s->r = nr;
+    s->cap = ncap;
+  }
+  s->r[s->n].off = off;
+  s->r[s->n].len = len;
+  s->n++;
+  return true;
+}
+
+static void scan_chunk(par_t *p, dc_regex_ctx_t *ctx, size_t i, slot_t *s) {
+  size_t lo = chunk_start(p, i);
+  size_t hi = chunk_start(p, i + 1);
+
+  s->n = 0;
+  s->limit = false;
+  s->failed = false;
+
+  size_t pos = lo, off = 0, len = 0;
+  bool limit = false;
+  while (dc_regex_find_line_ctx(p->re, ctx, p->block, hi, &pos, &off, &len, &limit)) {
+    if (!slot_push(s, off, len)) {
+      s->failed = true;
+      return;
+    }
+  }
+  s->limit = limit;
+}
+
+static void *worker_main(void *arg) {
+  worker_t *w = (worker_t *)arg;
+  par_t *p = w->p;
+
+  pthread_mutex_lock(&p->mu);
+  for (;;) {
+    if (p->next >= p->nchunks || p->next > p->stop_after) break;
+    if (p->next - p->emitted >= p->nslots) {
+      pthread_cond_wait(&p->space_cv, &p->mu);
+      continue;
+    }
+    size_t i = p->next++;
+    slot_t *s = &p->slots[i % p->nslots];
+    pthread_mutex_unlock(&p->mu);
+
+    scan_chunk(p, w->ctx, i, s);
+
+    pthread_mutex_lock(&p->mu);
+    s->ready = true;
+    if (s->limit && i < p->stop_after) p->stop_after = i;
+    pthread_cond_broadcast(&p->ready_cv);
+  }
+  pthread_mutex_unlock(&p->mu);
+  return NULL;
+}
+
+/* Serial scan with the same emission contract; used when threads are not
+ * worth it or cannot be started. */
+static bool scan_serial(const dc_regex_t *re, dc_regex_ctx_t *ctx, const uint8_t *block, size_t len,
+                        dc_regex_emit_fn emit, void *arg, bool *limit) {
+  size_t pos = 0, off = 0, n = 0;
+  while (dc_regex_find_line_ctx(re, ctx, block, len, &pos, &off, &n, limit)) {
+    if (!emit(arg, block + off, n)) return false;
+  }
+  return !*limit;
+}
+
+bool dc_regex_scan_par(const dc_regex_t *re,
+                       const uint8_t *block,
+                       size_t block_len,
+                       int nthreads,
+                       dc_regex_emit_fn emit,
+                       void *arg,
+                       bool *exec_limit_exceeded) {
+  bool limit = false;
+  if (exec_limit_exceeded) *exec_limit_exceeded = false;
+  if (!re || !emit) return false;
+
+  size_t nchunks = (block_len + PAR_CHUNK_SIZE - 1) / PAR_CHUNK_SIZE;
+  if (nthreads > PAR_MAX_THREADS) nthreads = PAR_MAX_THREADS;
+  if ((size_t)nthreads > nchunks) nthreads = (int)nchunks;
+  if (nthreads < 2) {
+    bool ok = scan_serial(re, re->ctx, block, block_len, emit, arg, &limit);
+    if (exec_limit_exceeded) *exec_limit_exceeded = limit;
+    return ok;
+  }
+
+  par_t p;
+  memset(&p, 0, sizeof(p));
+  p.re = re;
+  p.block = block;
+  p.len = block_len;
+  p.nchunks = nchunks;
+  p.stop_after = nchunks;
+  p.nslots = (size_t)nthreads * PAR_WINDOW_PER_THREAD;
+  p.slots = (slot_t *)calloc(p.nslots, sizeof(slot_t));
+  worker_t *ws = (worker_t *)calloc((size_t)nthreads, sizeof(worker_t));
+  if (!p.slots || !ws) {
+    free(p.slots);
+    free(ws);
+    bool ok = scan_serial(re, re->ctx, block, block_len, emit, arg, &limit);
+    if (exec_limit_exceeded) *exec_limit_exceeded = limit;
+    return ok;
+  }
+  pthread_mutex_init(&p.mu, NULL);
+  pthread_cond_init(&p.ready_cv, NULL);
+  pthread_cond_init(&p.space_cv, NULL);
+
+  // Workers must not take the shell's signals. SIGBUS stays open: a
+  // truncated mapping faults in the worker that reads it (see map.c), and
+  // a blocked synchronous fault would kill the process.
+  sigset_t all, old;
+  sigfillset(&all);
+  sigdelset(&all, SIGBUS);
+  pthread_sigmask(SIG_BLOCK, &all, &old);
+  int started = 0;
+  for (int t = 0; t < nthreads; t++) {
+    ws[t].p = &p;
+    ws[t].ctx = dc_regex_ctx_new(re);
+    if (!ws[t].ctx) break;
+    if (pthread_create(&ws[t].tid, NULL, worker_main, &ws[t]) != 0) {
+      dc_regex_ctx_free(ws[t].ctx);
+      ws[t].ctx = NULL;
+      break;
+    }
+    ws[t].started = true;
+    started++;
+  }
+  pthread_sigmask(SIG_SETMASK, &old, NULL);
+
+  bool ok = true;
+  if (started > 0) {
+    for (size_t i = 0; i < nchunks && ok; i++) {
+      slot_t *s = &p.slots[i % p.nslots];
+      pthread_mutex_lock(&p.mu);
+      while (!s->ready) pthread_cond_wait(&p.ready_cv, &p.mu);
+      pthread_mutex_unlock(&p.mu);
+
+      for (size_t k = 0; k < s->n && ok; k++) ok = emit(arg, block + s->r[k].off, s->r[k].len);
+      if (ok && s->failed) {
+        // The worker ran out of memory recording hits: finish the chunk
+        // here, after the last range it did record.
+        size_t pos = s->n ? s->r[s->n - 1].off + s->r[s->n - 1].len : chunk_start(&p, i);
+        size_t hi = chunk_start(&p, i + 1), off = 0, n = 0;
+        while (ok && dc_regex_find_line_ctx(re, re->ctx, block, hi, &pos, &off, &n, &limit)) {
+          ok = emit(arg, block + off, n);
+        }
+      } else if (s->limit) {
+        limit = true;
+      }
+      if (limit) ok = false;
+
+      pthread_mutex_lock(&p.mu);
+      s->ready = false;
+      p.emitted = i + 1;
+      if (!ok) p.stop_after = 0; /* let the remaining workers exit */
+      pthread_cond_broadcast(&p.space_cv);
+      pthread_mutex_unlock(&p.mu);
+    }
+  } else {
+    ok = scan_serial(re, re->ctx, block, block_len, emit, arg, &limit);
+  }
+
+  for (int t = 0; t < nthreads; t++) {
+    if (ws[t].started) pthread_join(ws[t].tid, NULL);
+    dc_regex_ctx_free(ws[t].ctx);
+  }
+  for (size_t k = 0; k < p.nslots; k++) free(p.slots[k].r);
+  free(p.slots);
+  free(ws);
+  pthread_cond_destroy(&p.space_cv);
+  pthread_cond_destroy(&p.ready_cv);
+  pthread_mutex_destroy(&p.mu);
+
+  if (exec_limit_exceeded) *exec_limit_exceeded = limit;
+  return ok;
+}
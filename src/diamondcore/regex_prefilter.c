@@ -0,0 +1,304 @@
+// regex_prefilter.c - required-literal prefilter for dc_regex
+//
+// At compile time the program is searched for a run of I_CHAR
+// instructions that every path to I_MATCH goes through (a dominator of
+// MATCH whose successors are forced). A subject without that literal
+// cannot match. When the pattern is anchored at the start, the leading
+// I_CHAR run must also sit at offset 0.
+//
+// Rejecting a line early must not hide an execution limit error the VM
+// would have reported. The per-position cost of the VM is bounded by the
+// shape of the program, so lines short enough that the VM cannot exceed
+// DC_REGEX_MAX_STEPS (and programs too small to overflow the active-state
+// limit) are the only ones the prefilter is allowed to decide.
+//
+// The same pass finds the shortest match length, which rejects short
+// lines under that rule, and the bytes a match can begin with. Skipping
+// bytes outside that set is exact at any length: with no live threads a
+// byte that starts nothing leaves the VM where it was, at the same cost
+// every time, which the engines charge for each byte they skip. The
+// scan to the next possible first byte uses the simd_int.h masks.
+
+#include "regex_int.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+/* Follow JMPs from PC; returns the first other instruction, or -1. */
+static int skip_jmps(const dc_regex_t *re, int pc) {
+  for (int hops = 0; pc >= 0 && pc < re->prog_len && hops <= re->prog_len; hops++) {
+    if (re->prog[pc].op != I_JMP) return pc;
+    pc = re->prog[pc].x;
+  }
+  return -1;
+}
+
+/* Collect the forced I_CHAR run starting at PC into BUF. */
+static size_t char_run(const dc_regex_t *re, int pc, uint8_t *buf, size_t cap) {
+  size_t n = 0;
+  pc = skip_jmps(re, pc);
+  while (n < cap && pc >= 0 && re->prog[pc].op == I_CHAR) {
+    buf[n++] = re->prog[pc].c;
+    pc = skip_jmps(re, re->prog[pc].x);
+  }
+  return n;
+}
+
+static int succs(const inst_t *ins, int out[2]) {
+  switch (ins->op) {
+    case I_MATCH: return 0;
+    case I_SPLIT: out[0] = ins->x; out[1] = ins->y; return 2;
+    default:      out[0] = ins->x; return 1;
+  }
+}
+
+/* Upper bound on states one VM transition processes, or 0 when the
+ * program is large enough to overflow the active-state or stack limits. */
+static uint64_t steps_per_pos(const dc_regex_t *re) {
+  uint64_t nlist = 0, npush = 1;
+  for (int pc = 0; pc < re->prog_len; pc++) {
+    switch (re->prog[pc].op) {
+      case I_SPLIT: npush += 2; break;
+      case I_JMP:
+      case I_EOL:   npush += 1; break;
+      default:      nlist += 1; break;
+    }
+  }
+  if (nlist >= DC_REGEX_MAX_ACTIVE_STATES || npush + 2 >= DC_REGEX_MAX_ACTIVE_STATES) return 0;
+  /* Thread list entries, plus every closure pop: one per closure call
+   * (each taken transition and the restart) and one per push. */
+  return 2 * nlist + npush;
+}
+
+/* Cooper-Harvey-Kennedy dominators over the instructions reachable from
+ * start_pc; fills IDOM (-1 for unreachable) and returns false on OOM. */
+static bool dominators(const dc_regex_t *re, int *idom) {
+  int n = re->prog_len;
+  int *po = (int *)malloc((size_t)n * sizeof(int));     /* postorder number */
+  int *order = (int *)malloc((size_t)n * sizeof(int));  /* nodes by postorder */
+  int *stack = (int *)malloc((size_t)n * sizeof(int));
+  uint8_t *next = (uint8_t *)calloc((size_t)n, 1);      /* next successor to visit */
+  int *pstart = (int *)calloc((size_t)n + 1, sizeof(int));
+  int *preds = (int *)malloc((size_t)n * 2 * sizeof(int));
+  bool ok = po && order && stack && next && pstart && preds;
+  if (!ok) goto done;
+
+  for (int i = 0; i < n; i++) { po[i] = -1; idom[i] = -1; }
+
+  /* Iterative DFS for the postorder. */
+  int np = 0, sp = 0;
+  stack[sp++] = re->start_pc;
+  po[re->start_pc] = -2; /* on the stack */
+  while (sp > 0) {
+    int v = stack[sp - 1];
+    int s[2];
+    int ns = succs(&re->prog[v], s);
+    if (next[v] < ns) {
+      int w = s[next[v]++];
+      if (w >= 0 && w < n && po[w] == -1) {
+        po[w] = -2;
+        stack[sp++] = w;
+      }
+      continue;
+    }
+    sp--;
+    po[v] = np;
+    order[np++] = v;
+  }
+
+  /* Predecessor lists of reachable nodes. */
+  for (int k = 0; k < np; k++) {
+    int s[2];
+    int ns = succs(&re->prog[order[k]], s);
+    for (int j = 0; j < ns; j++) if (s[j] >= 0 && s[j] < n) pstart[s[j] + 1]++;
+  }
+  for (int i = 0; i < n; i++) pstart[i + 1] += pstart[i];
+  for (int i = 0; i < n; i++) stack[i] = pstart[i];
+  for (int k = 0; k < np; k++) {
+    int s[2];
+    int ns = succs(&re->prog[order[k]], s);
+    for (int j = 0; j < ns; j++) if (s[j] >= 0 && s[j] < n) preds[stack[s[j]]++] = order[k];
+  }
+
+  idom[re->start_pc] = re->start_pc;
+  for (bool changed = true; changed;) {
+    changed = false;
+    for (int k = np - 2; k >= 0; k--) { /* reverse postorder, root excluded */
+      int v = order[k];
+      int nd = -1;
+      for (int j = pstart[v]; j < pstart[v + 1]; j++) {
+        int p = preds[j];
+        if (idom[p] < 0) continue;
+        if (nd < 0) { nd = p; continue; }
+        int a = p, b = nd;
+        while (a != b) {
+          while (po[a] < po[b]) a = idom[a];
+          while (po[b] < po[a]) b = idom[b];
+        }
+        nd = a;
+      }
+      if (nd >= 0 && idom[v] != nd) {
+        idom[v] = nd;
+        changed = true;
+      }
+    }
+  }
+
+done:
+  free(po);
+  free(order);
+  free(stack);
+  free(next);
+  free(pstart);
+  free(preds);
+  return ok;
+}
+
+/* Fewest consuming instructions on a path from start_pc to MATCH: a
+ * 0-1 breadth-first search, as only CHAR, ANY and CLASS cost a byte. */
+static size_t min_match_len(const dc_regex_t *re) {
+  int n = re->prog_len;
+  if (n <= 0) return 0;
+  size_t cap = (size_t)n * 2 + 2; /* an edge relaxes once, from a settled pc */
+  size_t *dist = (size_t *)malloc((size_t)n * sizeof(size_t));
+  int *dq = (int *)malloc(cap * sizeof(int));
+  uint8_t *done = (uint8_t *)calloc((size_t)n, 1);
+  size_t best = 0;
+  if (!dist || !dq || !done) goto out;
+
+  for (int i = 0; i < n; i++) dist[i] = SIZE_MAX;
+  size_t head = 0, tail = 0;
+  dist[re->start_pc] = 0;
+  dq[tail++] = re->start_pc;
+  while (head != tail) {
+    int pc = dq[head];
+    head = (head + 1) % cap;
+    if (done[pc]) continue;
+    done[pc] = 1;
+    const inst_t *ins = &re->prog[pc];
+    if (ins->op == I_MATCH) {
+      best = dist[pc];
+      break;
+    }
+    size_t w = (ins->op == I_CHAR || ins->op == I_ANY || ins->op == I_CLASS) ? 1 : 0;
+    int s[2];
+    int ns = succs(ins, s);
+    for (int j = 0; j < ns; j++) {
+      int v = s[j];
+      if (v < 0 || v >= n || done[v] || dist[pc] + w >= dist[v]) continue;
+      dist[v] = dist[pc] + w;
+      if (w == 0) {
+        head = (head + cap - 1) % cap;
+        dq[head] = v;
+      } else {
+        dq[tail] = v;
+        tail = (tail + 1) % cap;
+      }
+    }
+  }
+
+out:
+  free(dist);
+  free(dq);
+  free(done);
+  return best;
+}
+
+/* The bytes accepted by the closure of start_pc, as the VM restarts it in
+ * the middle of a subject. No skipping when that closure holds MATCH or
+ * `.`, or when every byte can begin a match. */
+static void first_bytes(dc_regex_t *re) {
+  int n = re->prog_len;
+  if (n <= 0) return;
+  uint8_t bits[32] = { 0 };
+  uint8_t *seen = (uint8_t *)calloc((size_t)n, 1);
+  int *stack = (int *)malloc(((size_t)n * 2 + 1) * sizeof(int));
+  bool ok = seen && stack;
+  int sp = 0;
+  if (ok) stack[sp++] = re->start_pc;
+  while (ok && sp > 0) {
+    int pc = stack[--sp];
+    if (pc < 0 || pc >= n || seen[pc]) continue;
+    seen[pc] = 1;
+    const inst_t *ins = &re->prog[pc];
+    switch (ins->op) {
+      case I_JMP:   stack[sp++] = ins->x; break;
+      case I_SPLIT: stack[sp++] = ins->x; stack[sp++] = ins->y; break;
+      case I_EOL:   break; /* not at the end of the subject */
+      case I_CHAR:  bits[ins->c >> 3] |= (uint8_t)(1u << (ins->c & 7)); break;
+      case I_CLASS:
+        if (ins->cls < (uint16_t)re->class_len) {
+          for (int i = 0; i < 32; i++) bits[i] |= re->classes[ins->cls].bits[i];
+        }
+        break;
+      default:      ok = false; break; /* I_ANY, I_MATCH */
+    }
+  }
+  free(seen);
+  free(stack);
+
+  dc_byteset_init(&re->first, bits);
+  re->first_skip = ok && re->first.n < 256;
+}
+
+size_t dc_re_skip_idle(const dc_regex_t *re, const uint8_t *subject, size_t i, size_t end) {
+  const dc_byteset_t *fs = &re->first;
+  if (i >= end || dc_byteset_has(fs, subject[i])) return i;
+  if (fs->n == 1) {
+    const uint8_t *p = (const uint8_t *)memchr(subject + i, fs->eq[0], end - i);
+    return p ? (size_t)(p - subject) : end;
+  }
+  bool avx2 = dc_simd_avx2();
+  if (dc_byteset_vector(fs, avx2)) {
+    for (; i + 64 <= end; i += 64) {
+      uint64_t m = dc_byteset_mask64(fs, subject + i, avx2);
+      if (m) return i + (size_t)__builtin_ctzll(m);
+    }
+  }
+  while (i < end && !dc_byteset_has(fs, subject[i])) i++;
+  return i;
+}
+
+void dc_re_prefilter_init(dc_regex_t *re) {
+  re->pre_len = 0;
+  re->lit_len = 0;
+  re->safe_len = 0;
+  re->min_len = 0;
+  re->first_skip = false;
+  memset(&re->first, 0, sizeof(re->first));
+
+  if (!re->anchor_start) first_bytes(re);
+
+  uint64_t per_pos = steps_per_pos(re);
+  if (per_pos == 0 || per_pos > DC_REGEX_MAX_STEPS) return;
+  /* Initial closure plus one transition per subject byte. */
+  re->safe_len = (size_t)(DC_REGEX_MAX_STEPS / per_pos) - 1;
+  re->min_len = min_match_len(re);
+
+  if (re->anchor_start) re->pre_len = char_run(re, re->start_pc, re->pre, DC_RE_LIT_MAX);
+
+  int *idom = (int *)malloc((size_t)re->prog_len * sizeof(int));
+  if (!idom) return;
+  if (dominators(re, idom)) {
+    int mpc = -1;
+    for (int pc = 0; pc < re->prog_len; pc++) {
+      if (re->prog[pc].op == I_MATCH && idom[pc] >= 0) { mpc = pc; break; }
+    }
+
+    /* Every dominator of MATCH lies on its idom chain; keep the longest
+     * forced literal starting at one of them. */
+    uint8_t run[DC_RE_LIT_MAX];
+    for (int pc = mpc; pc >= 0; pc = (pc == re->start_pc) ? -1 : idom[pc]) {
+      if (re->prog[pc].op != I_CHAR) continue;
+      size_t n = char_run(re, pc, run, DC_RE_LIT_MAX);
+      if (n > re->lit_len) {
+        memcpy(re->lit, run, n);
+        re->lit_len = n;
+      }
+    }
+  }
+  free(idom);
+
+  /* The anchored prefix check already covers a literal no longer than it. */
+  if (re->pre_len > 0 && re->lit_len <= re->pre_len) re->lit_len = 0;
+}
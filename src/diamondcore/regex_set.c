@@ -0,0 +1,247 @@
+// regex_set.c - several patterns matched as one (match -e / -f)
+//
+// A line is selected when any pattern matches it. Unanchored patterns that
+// are plain literals go into one Aho-Corasick automaton, whose cost per
+// byte does not depend on how many there are. The others are packed, in
+// order and by their ^ / $ anchors, into alternations of at most
+// DC_RE_SET_GROUP_INSN instructions that are compiled as ordinary
+// patterns; a pattern too large to share one stays on its own. An
+// alternation has the limits of a single pattern, which a long line can
+// reach where none of its members would, so the members are kept compiled
+// on their own and take over when it does: a set reports a limit only
+// where one of its patterns does.
+
+#include "regex_int.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* Escapes allowed outside brackets; see parse_escape_outside. */
+static bool is_escapable(char c) { return c != '\0' && strchr(".*+?|()[]^$\\", c) != NULL; }
+
+static bool is_special(char c) { return strchr(".*+?|()[]^$\\{}", c) != NULL; }
+
+/* The bytes BODY matches if it is a plain literal, unescaped into OUT;
+ * returns the length or -1. */
+static long literal_of(const char *body, size_t len, uint8_t *out) {
+  size_t n = 0;
+  for (size_t i = 0; i < len; i++) {
+    char c = body[i];
+    if (c == '\\') {
+      if (i + 1 >= len || !is_escapable(body[i + 1])) return -1;
+      c = body[++i];
+    } else if (is_special(c)) {
+      return -1;
+    }
+    out[n++] = (uint8_t)c;
+  }
+  return (long)n;
+}
+
+typedef struct {
+  const char *body; /* pattern without its anchors */
+  size_t len;
+  dc_regex_t *re;   /* the pattern compiled on its own */
+} member_t;
+
+static bool add_sub(dc_re_set_t *set, dc_regex_t *re, size_t span) {
+  dc_regex_t **ns = (dc_regex_t **)realloc(set->sub, (set->nsub + 1) * sizeof(*ns));
+  if (!ns) return false;
+  set->sub = ns;
+  size_t *sp = (size_t *)realloc(set->span, (set->nsub + 1) * sizeof(*sp));
+  if (!sp) return false;
+  set->span = sp;
+  set->sub[set->nsub] = re;
+  set->span[set->nsub++] = span;
+  return true;
+}
+
+/* Add members [0, N) behind one alternation of them, or on their own if
+ * it does not compile. */
+static bool flush_group(dc_re_set_t *set, member_t *m, size_t n, bool bol, bool eol) {
+  if (n == 0) return true;
+  if (n > 1) {
+    size_t cap = 2 + n * 3;
+    for (size_t i = 0; i < n; i++) cap += m[i].len;
+    char *text = (char *)malloc(cap + 1);
+    if (!text) return false;
+    size_t w = 0;
+    if (bol) text[w++] = '^';
+    for (size_t i = 0; i < n; i++) {
+      if (i > 0) text[w++] = '|';
+      text[w++] = '(';
+      memcpy(text + w, m[i].body, m[i].len);
+      w += m[i].len;
+      text[w++] = ')';
+    }
+    if (eol) text[w++] = '$';
+    text[w] = '\0';
+
+    dc_regex_t *re = NULL;
+    char eb[256];
+    bool ok = dc_regex_compile(&re, text, eb);
+    free(text);
+    if (ok && !add_sub(set, re, n)) {
+      dc_regex_free(re);
+      return false;
+    }
+  }
+  for (size_t i = 0; i < n; i++) {
+    if (!add_sub(set, m[i].re, 0)) return false;
+    m[i].re = NULL;
+  }
+  return true;
+}
+
+void dc_re_set_free(dc_re_set_t *set) {
+  if (!set) return;
+  dc_re_ac_free(set->ac);
+  for (size_t i = 0; i < set->nsub; i++) dc_regex_free(set->sub[i]);
+  free(set->sub);
+  free(set->span);
+  free(set);
+}
+
+static bool build_set(dc_re_set_t *set, const char *const *patterns, size_t n, char errbuf[256]) {
+  bool ok = false;
+  member_t *m = (member_t *)calloc(n ? n : 1, sizeof(*m));
+  bool *anch = (bool *)calloc(n ? n * 2 : 1, sizeof(bool));
+  const uint8_t **lits = (const uint8_t **)calloc(n ? n : 1, sizeof(*lits));
+  size_t *lens = (size_t *)calloc(n ? n : 1, sizeof(size_t));
+  uint8_t **owned = (uint8_t **)calloc(n ? n : 1, sizeof(*owned));
+  size_t nm = 0, nlit = 0;
+  if (!m || !anch || !lits || !lens || !owned) goto nomem;
+
+  for (size_t i = 0; i < n; i++) {
+    const char *p = patterns[i];
+    size_t plen = strlen(p);
+    bool bol = false, eol = false;
+    size_t start = 0, end = plen;
+    dc_re_split_anchors(p, plen, &bol, &eol, &start, &end);
+
+    if (!bol && !eol && plen <= DC_REGEX_MAX_PATTERN_LEN) {
+      uint8_t *buf = (uint8_t *)malloc(plen + 1);
+      if (!buf) goto nomem;
+      long ln = literal_of(p, plen, buf);
+      if (ln >= 0) {
+        owned[nlit] = buf;
+        lits[nlit] = buf;
+        lens[nlit++] = (size_t)ln;
+        continue;
+      }
+      free(buf);
+    }
+
+    if (!dc_regex_compile(&m[nm].re, p, errbuf)) goto done;
+    m[nm].body = p + start;
+    m[nm].len = end >= start ? end - start : 0;
+    anch[nm * 2] = bol;
+    anch[nm * 2 + 1] = eol;
+    nm++;
+  }
+
+  if (nlit > 0 && !(set->ac = dc_re_ac_new(lits, lens, nlit))) goto nomem;
+
+  // Pack each anchor kind separately, in pattern order. An empty body
+  // (`^`, `$`, `^$`) cannot be parenthesized and stays alone.
+  member_t *grp = (member_t *)calloc(nm ? nm : 1, sizeof(*grp));
+  if (!grp) goto nomem;
+  for (int kind = 0; kind < 4; kind++) {
+    bool bol = (kind & 2) != 0, eol = (kind & 1) != 0;
+    size_t ng = 0, insn = 0, text = 2;
+    for (size_t i = 0; i < nm; i++) {
+      if (anch[i * 2] != bol || anch[i * 2 + 1] != eol) continue;
+      size_t pl = (size_t)m[i].re->prog_len;
+      bool alone = m[i].len == 0;
+      if (ng > 0 && (alone || insn + pl > DC_RE_SET_GROUP_INSN ||
+                     text + m[i].len + 3 > DC_REGEX_MAX_PATTERN_LEN)) {
+        if (!flush_group(set, grp, ng, bol, eol)) goto grp_nomem;
+        ng = 0; insn = 0; text = 2;
+      }
+      grp[ng++] = m[i];
+      m[i].re = NULL;
+      insn += pl;
+      text += m[i].len + 3;
+      if (alone) {
+        if (!flush_group(set, grp, ng, bol, eol)) goto grp_nomem;
+        ng = 0; insn = 0; text = 2;
+      }
+    }
+    if (!flush_group(set, grp, ng, bol, eol)) goto grp_nomem;
+  }
+  free(grp);
+  ok = true;
+  goto done;
+
+grp_nomem:
+  for (size_t i = 0; i < nm; i++) dc_regex_free(grp[i].re); /* members not yet moved */
+  free(grp);
+
+nomem:
+  if (errbuf) snprintf(errbuf, 256, "match: out of memory");
+done:
+  if (m) for (size_t i = 0; i < nm; i++) dc_regex_free(m[i].re);
+  if (owned) for (size_t i = 0; i < nlit; i++) free(owned[i]);
+  free(m);
+  free(anch);
+  free(lits);
+  free(lens);
+  free(owned);
+  return ok;
+}
+
+bool dc_regex_compile_set(dc_regex_t **out_re, const char *const *patterns, size_t n, char errbuf[256]) {
+  if (errbuf) errbuf[0] = '\0';
+  if (!out_re || (n > 0 && !patterns)) return false;
+  if (n == 1) return dc_regex_compile(out_re, patterns[0], errbuf);
+
+  dc_regex_t *re = (dc_regex_t *)calloc(1, sizeof(*re));
+  if (re) re->set = (dc_re_set_t *)calloc(1, sizeof(dc_re_set_t));
+  if (!re || !re->set) {
+    free(re);
+    if (errbuf) snprintf(errbuf, 256, "match: out of memory");
+    return false;
+  }
+  if (!build_set(re->set, patterns, n, errbuf)) {
+    dc_regex_free(re);
+    return false;
+  }
+  re->ctx = dc_regex_ctx_new(re);
+  if (!re->ctx) {
+    dc_regex_free(re);
+    if (errbuf) snprintf(errbuf, 256, "match: out of memory");
+    return false;
+  }
+  *out_re = re;
+  return true;
+}
+
+bool dc_re_set_match(const dc_regex_t *re, dc_regex_ctx_t *ctx,
+                     const uint8_t *subject, size_t subject_len, bool *limit) {
+  const dc_re_set_t *set = re->set;
+  if (set->ac && dc_re_ac_match(set->ac, subject, subject_len)) return true;
+  for (size_t i = 0; i < set->nsub; i += 1 + set->span[i]) {
+    bool lim = false;
+    if (dc_regex_match_line_ctx(set->sub[i], ctx->sub[i], subject, subject_len, &lim)) return true;
+    if (!lim) continue;
+    if (set->span[i] == 0) {
+      *limit = true;
+      return false;
+    }
+    for (size_t j = i + 1; j <= i + set->span[i]; j++) {
+      if (dc_regex_match_line_ctx(set->sub[j], ctx->sub[j], subject, subject_len, &lim)) return true;
+      if (lim) {
+        *limit = true;
+        return false;
+      }
+    }
+  }
+  return false;
+}
+
+size_t dc_re_set_mem_size(const dc_re_set_t *set) {
+  size_t n = sizeof(*set) + dc_re_ac_mem_size(set->ac) + set->nsub * (sizeof(dc_regex_t *) + sizeof(size_t));
+  for (size_t i = 0; i < set->nsub; i++) n += dc_re_mem_size(set->sub[i]);
+  return n;
+}
@@ -0,0 +1,214 @@
+// simd_int.h - 64-byte block scanning helpers shared by the core
+//
+// Each helper returns a 64-bit mask with bit i set when byte P[i] is in the
+// class; callers walk the masks with ctz/popcount. AVX2 is chosen at run
+// time, SSE2 is the x86 baseline and other targets use a scalar loop.
+
+#ifndef DC_SIMD_INT_H
+#define DC_SIMD_INT_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define DC_SIMD_X86 1
+#endif
+
+/* Whether the AVX2 variants may be used; probed once per translation unit
+ * (racing first calls all store the same answer). */
+static inline bool dc_simd_avx2(void) {
+#if DC_SIMD_X86
+  static int avx2 = -1;
+  if (avx2 < 0) {
+    __builtin_cpu_init();
+    avx2 = __builtin_cpu_supports("avx2") ? 1 : 0;
+  }
+  return avx2 != 0;
+#else
+  return false;
+#endif
+}
+
+/* Bytes equal to B. */
+static inline uint64_t dc_eq_mask64_scalar(const uint8_t *p, uint8_t b) {
+  uint64_t m = 0;
+  for (int i = 0; i < 64; i++) m |= (uint64_t)(p[i] == b) << i;
+  return m;
+}
+
+#if DC_SIMD_X86 && defined(__SSE2__)
+static inline uint64_t dc_eq_mask64_sse2(const uint8_t *p, uint8_t b) {
+  const __m128i v = _mm_set1_epi8((char)b);
+  uint64_t m = 0;
+  for (int i = 0; i < 4; i++) {
+    __m128i x = _mm_loadu_si128((const __m128i *)(const void *)(p + 16 * i));
+    m |= (uint64_t)(uint16_t)_mm_movemask_epi8(_mm_cmpeq_epi8(x, v)) << (16 * i);
+  }
+  return m;
+}
+#endif
+
+#if DC_SIMD_X86
+__attribute__((target("avx2")))
+static inline uint64_t dc_eq_mask64_avx2(const uint8_t *p, uint8_t b) {
+  const __m256i v = _mm256_set1_epi8((char)b);
+  __m256i lo = _mm256_loadu_si256((const __m256i *)(const void *)p);
+  __m256i hi = _mm256_loadu_si256((const __m256i *)(const void *)(p + 32));
+  return (uint64_t)(uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(lo, v)) |
+         (uint64_t)(uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(hi, v)) << 32;
+}
+#endif
+
+/* ASCII whitespace: ' ' and '\t'..'\r' (0x09..0x0d), i.e. a byte is
+ * whitespace when it is ' ' or (c - 0x09) <= 4 unsigned. */
+static inline uint64_t dc_ws_mask64_scalar(const uint8_t *p) {
+  uint64_t m = 0;
+  for (int i = 0; i < 64; i++) m |= (uint64_t)(p[i] == ' ' || (uint8_t)(p[i] - 0x09) <= 4) << i;
+  return m;
+}
+
+#if DC_SIMD_X86 && defined(__SSE2__)
+static inline uint64_t dc_ws_mask64_sse2(const uint8_t *p) {
+  const __m128i sp = _mm_set1_epi8(' ');
+  const __m128i lo = _mm_set1_epi8(0x09);
+  const __m128i span = _mm_set1_epi8(4);
+  uint64_t m = 0;
+  for (int i = 0; i < 4; i++) {
+    __m128i x = _mm_loadu_si128((const __m128i *)(const void *)(p + 16 * i));
+    __m128i d = _mm_sub_epi8(x, lo);
+    __m128i ws = _mm_or_si128(_mm_cmpeq_epi8(x, sp), _mm_cmpeq_epi8(_mm_min_epu8(d, span), d));
+    m |= (uint64_t)(uint16_t)_mm_movemask_epi8(ws) << (16 * i);
+  }
+  return m;
+}
+#endif
+
+#if DC_SIMD_X86
+__attribute__((target("avx2")))
+static inline uint64_t dc_ws_mask64_avx2(const uint8_t *p) {
+  const __m256i sp = _mm256_set1_epi8(' ');
+  const __m256i lo = _mm256_set1_epi8(0x09);
+  const __m256i span = _mm256_set1_epi8(4);
+  uint64_t m = 0;
+  for (int i = 0; i < 2; i++) {
+    __m256i x = _mm256_loadu_si256((const __m256i *)(const void *)(p + 32 * i));
+    __m256i d = _mm256_sub_epi8(x, lo);
+    __m256i ws = _mm256_or_si256(_mm256_cmpeq_epi8(x, sp), _mm256_cmpeq_epi8(_mm256_min_epu8(d, span), d));
+    m |= (uint64_t)(uint32_t)_mm256_movemask_epi8(ws) << (32 * i);
+  }
+  return m;
+}
+#endif
+
+static inline uint64_t dc_eq_mask64(const uint8_t *p, uint8_t b, bool avx2) {
+#if DC_SIMD_X86
+  if (avx2) return dc_eq_mask64_avx2(p, b);
+#if defined(__SSE2__)
+  return dc_eq_mask64_sse2(p, b);
+#endif
+#endif
+  (void)avx2;
+  return dc_eq_mask64_scalar(p, b);
+}
+
+/* A set of bytes prepared for 64-byte scans. Up to DC_BYTESET_EQ_MAX
+ * bytes are compared one by one (SSE2 or AVX2). Larger sets use two
+ * nibble tables with AVX2: byte b is in the set when lo[b & 15] &
+ * hi[b >> 4] is non-zero, which is exact as long as the high nibbles fall
+ * into at most eight groups with equal low-nibble sets. Other sets, and
+ * AVX2-less CPUs for large sets, have no vector scan (dc_byteset_vector). */
+#define DC_BYTESET_EQ_MAX 3
+
+typedef struct {
+  uint8_t bits[32];
+  int n;
+  uint8_t eq[DC_BYTESET_EQ_MAX]; /* the bytes, when n <= DC_BYTESET_EQ_MAX */
+  bool nibble;                   /* lo/hi are valid */
+  uint8_t lo[16];
+  uint8_t hi[16];
+} dc_byteset_t;
+
+static inline bool dc_byteset_has(const dc_byteset_t *bs, uint8_t b) {
+  return (bs->bits[b >> 3] & (uint8_t)(1u << (b & 7))) != 0;
+}
+
+static inline void dc_byteset_init(dc_byteset_t *bs, const uint8_t bits[32]) {
+  uint16_t lows[16] = { 0 };
+  memset(bs, 0, sizeof(*bs));
+  for (int b = 0; b < 256; b++) {
+    if (!(bits[b >> 3] & (1u << (b & 7)))) continue;
+    bs->bits[b >> 3] |= (uint8_t)(1u << (b & 7));
+    if (bs->n < DC_BYTESET_EQ_MAX) bs->eq[bs->n] = (uint8_t)b;
+    bs->n++;
+    lows[b >> 4] |= (uint16_t)(1u << (b & 15));
+  }
+
+  /* One bucket per distinct low-nibble set. */
+  uint16_t bucket[8];
+  int nb = 0;
+  for (int h = 0; h < 16; h++) {
+    if (!lows[h]) continue;
+    int k = 0;
+    while (k < nb && bucket[k] != lows[h]) k++;
+    if (k == nb) {
+      if (nb == 8) return;
+      bucket[nb++] = lows[h];
+    }
+    bs->hi[h] |= (uint8_t)(1u << k);
+    for (int l = 0; l < 16; l++) {
+      if (lows[h] & (1u << l)) bs->lo[l] |= (uint8_t)(1u << k);
+    }
+  }
+  bs->nibble = true;
+}
+
+/* Whether dc_byteset_mask64 beats testing bytes one at a time. */
+static inline bool dc_byteset_vector(const dc_byteset_t *bs, bool avx2) {
+#if DC_SIMD_X86
+  if (avx2 && bs->nibble) return true;
+#if defined(__SSE2__)
+  return bs->n <= DC_BYTESET_EQ_MAX;
+#endif
+#endif
+  (void)bs;
+  (void)avx2;
+  return false;
+}
+
+#if DC_SIMD_X86
+__attribute__((target("avx2")))
+static inline uint64_t dc_byteset_mask64_avx2(const dc_byteset_t *bs, const uint8_t *p) {
+  const __m256i lo = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i *)(const void *)bs->lo));
+  const __m256i hi = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i *)(const void *)bs->hi));
+  const __m256i nib = _mm256_set1_epi8(0x0f);
+  const __m256i zero = _mm256_setzero_si256();
+  uint64_t m = 0;
+  for (int i = 0; i < 2; i++) {
+    __m256i x = _mm256_loadu_si256((const __m256i *)(const void *)(p + 32 * i));
+    __m256i l = _mm256_shuffle_epi8(lo, _mm256_and_si256(x, nib));
+    __m256i h = _mm256_shuffle_epi8(hi, _mm256_and_si256(_mm256_srli_epi16(x, 4), nib));
+    __m256i out = _mm256_cmpeq_epi8(_mm256_and_si256(l, h), zero);
+    m |= (uint64_t)(uint32_t)~_mm256_movemask_epi8(out) << (32 * i);
+  }
+  return m;
+}
+#endif
+
+/* Bytes in BS. */
+static inline uint64_t dc_byteset_mask64(const dc_byteset_t *bs, const uint8_t *p, bool avx2) {
+#if DC_SIMD_X86
+  if (avx2 && bs->nibble) return dc_byteset_mask64_avx2(bs, p);
+#endif
+  if (bs->n <= DC_BYTESET_EQ_MAX) {
+    uint64_t m = 0;
+    for (int k = 0; k < bs->n; k++) m |= dc_eq_mask64(p, bs->eq[k], avx2);
+    return m;
+  }
+  uint64_t m = 0;
+  for (int i = 0; i < 64; i++) m |= (uint64_t)dc_byteset_has(bs, p[i]) << i;
+  return m;
+}
+
+#endif /* DC_SIMD_INT_H */
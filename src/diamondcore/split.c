@@ -1,8 +1,10 @@
 // split.c - ASCII whitespace field splitting utilities
 
 #include "diamondcore.h"
+#include "simd_int.h"
 
 #include <stdlib.h>
+#include <string.h>
 
 static inline bool is_ws(uint8_t c) {
   // ASCII whitespace used by spec:
@@ -11,49 +13,198 @@ static inline bool is_ws(uint8_t c) {
           c == '\f');
 }
 
-size_t dc_split_ws(const uint8_t *line, size_t len, dc_field_view_t **out_fields) {
-  if (out_fields) *out_fields = NULL;
-  if (!out_fields || (!line && len != 0)) return 0;
+typedef uint64_t (*ws_mask_fn)(const uint8_t *p);
+
+/* Picked on first use; racing first calls all store the same pointer. */
+static ws_mask_fn ws_mask;
+
+static ws_mask_fn pick_ws_mask(void) {
+  ws_mask_fn fn = dc_ws_mask64_scalar;
+#if DC_SIMD_X86
+  if (dc_simd_avx2()) fn = dc_ws_mask64_avx2;
+#if defined(__SSE2__)
+  else fn = dc_ws_mask64_sse2;
+#endif
+#endif
+  ws_mask = fn;
+  return fn;
+}
+
+static bool push_field(dc_field_view_t **v, size_t *cap, size_t cnt,
+                       const uint8_t *ptr, size_t len) {
+  if (cnt == *cap) {
+    size_t ncap = *cap ? *cap * 2 : 8;
+    dc_field_view_t *nv = (dc_field_view_t *)realloc(*v, ncap * sizeof(*nv));
+    if (!nv) return false;
+    *v = nv;
+    *cap = ncap;
+  }
+  (*v)[cnt].ptr = ptr;
+  (*v)[cnt].len = len;
+  return true;
+}
+
+size_t dc_split_ws_into(const uint8_t *line, size_t len, size_t max_fields,
+                        dc_field_view_t **fields, size_t *cap) {
+  if (!fields || !cap || (!line && len != 0)) return 0;
+
+  ws_mask_fn mask_of = ws_mask ? ws_mask : pick_ws_mask();
 
-  dc_field_view_t *v = NULL;
-  size_t cap = 0;
   size_t cnt = 0;
 
-  size_t i = 0;
-  while (i < len) {
-    // Skip whitespace.
-    while (i < len && is_ws(line[i])) i++;
-    if (i >= len) break;
-
-    // Start of field.
-    size_t start = i;
-    while (i < len && !is_ws(line[i])) i++;
-    size_t flen = i - start;
-    if (flen == 0) continue;
-
-    if (cnt == cap) {
-      size_t ncap = cap ? cap * 2 : 8;
-      dc_field_view_t *nv = (dc_field_view_t *)realloc(v, ncap * sizeof(*nv));
-      if (!nv) {
-        free(v);
-        *out_fields = NULL;
-        return (size_t)-1;
-      }
-      v = nv;
-      cap = ncap;
+  // Field boundaries are the bits where "non-whitespace" flips between
+  // neighbouring bytes; they alternate start, end, start, ...
+  uint64_t carry = 0;     // bit 0: previous byte was non-whitespace
+  bool open = false;
+  size_t start = 0;
+  uint8_t pad[64];
+
+  for (size_t base = 0; base < len; base += 64) {
+    uint64_t ws;
+    if (len - base >= 64) {
+      ws = mask_of(line + base);
+    } else {
+      // Short tail: pad with whitespace, which also closes an open field.
+      memset(pad, ' ', sizeof(pad));
+      memcpy(pad, line + base, len - base);
+      ws = mask_of(pad);
     }
 
-    v[cnt].ptr = line + start;
-    v[cnt].len = flen;
+    uint64_t word = ~ws;
+    uint64_t flips = word ^ ((word << 1) | carry);
+    carry = word >> 63;
+
+    while (flips) {
+      size_t at = base + (size_t)__builtin_ctzll(flips);
+      flips &= flips - 1;
+      if (!open) {
+        start = at;
+      } else {
+        if (!push_field(fields, cap, cnt, line + start, at - start)) return (size_t)-1;
+        if (++cnt == max_fields) return cnt;
+      }
+      open = !open;
+    }
+  }
+  if (open) {
+    // Field runs to the end of a full final block.
+    if (!push_field(fields, cap, cnt, line + start, len - start)) return (size_t)-1;
     cnt++;
   }
+  return cnt;
+}
+
+/* Runs shorter than this are the common case and are cheaper to walk
+ * byte by byte than to classify as a block. */
+#define WS_SCALAR_FIRST 16u
+
+size_t dc_ws_prefix_len(const uint8_t *p, size_t len) {
+  size_t i = 0;
+  while (i < len && i < WS_SCALAR_FIRST && is_ws(p[i])) i++;
+  if (i < WS_SCALAR_FIRST) return i;
+
+  ws_mask_fn mask_of = ws_mask ? ws_mask : pick_ws_mask();
+  for (; i + 64 <= len; i += 64) {
+    uint64_t word = ~mask_of(p + i);
+    if (word) return i + (size_t)__builtin_ctzll(word);
+  }
+  while (i < len && is_ws(p[i])) i++;
+  return i;
+}
+
+size_t dc_ws_suffix_len(const uint8_t *p, size_t len) {
+  size_t n = len;
+  while (n > 0 && len - n < WS_SCALAR_FIRST && is_ws(p[n - 1])) n--;
+  if (len - n < WS_SCALAR_FIRST) return len - n;
+
+  ws_mask_fn mask_of = ws_mask ? ws_mask : pick_ws_mask();
+  for (; n >= 64; n -= 64) {
+    // Bit 63 is the last byte, so leading ones count from the end.
+    uint64_t word = ~mask_of(p + n - 64);
+    if (word) return len - n + (size_t)__builtin_clzll(word);
+  }
+  while (n > 0 && is_ws(p[n - 1])) n--;
+  return len - n;
+}
+
+size_t dc_trimmed_lines_len(const uint8_t *p, size_t len) {
+  ws_mask_fn mask_of = ws_mask ? ws_mask : pick_ws_mask();
+  bool avx2 = dc_simd_avx2();
+
+  // A line is clean when its first byte and the byte before its '\n' are
+  // neither whitespace nor '\n' (the latter catches empty lines). Both
+  // conditions are bit tests on the newline and whitespace masks.
+  size_t done = 0;          // end of the last clean line seen
+  uint64_t start_carry = 1; // bit 0 of the next block starts a line
+  uint64_t ws_carry = 0;    // last byte of the previous block was whitespace
+  uint8_t pad[64];
 
-  if (cnt == 0) {
+  for (size_t base = 0; base < len; base += 64) {
+    const uint8_t *blk = p + base;
+    uint64_t valid = ~(uint64_t)0;
+    if (len - base < 64) {
+      // Pad with a byte that is neither whitespace nor '\n'.
+      memset(pad, 'x', sizeof(pad));
+      memcpy(pad, blk, len - base);
+      blk = pad;
+      valid = ((uint64_t)1 << (len - base)) - 1;
+    }
+    uint64_t nl = dc_eq_mask64(blk, '\n', avx2) & valid;
+    uint64_t ws = mask_of(blk) & valid;
+
+    uint64_t bad = (((nl << 1) | start_carry) & ws) | (nl & ((ws << 1) | ws_carry));
+    if (bad) {
+      // Keep the lines that ended before the first offending byte.
+      uint64_t before = nl & ((((uint64_t)1) << __builtin_ctzll(bad)) - 1);
+      if (before) done = base + 64 - (size_t)__builtin_clzll(before);
+      return done;
+    }
+    if (nl) done = base + 64 - (size_t)__builtin_clzll(nl);
+    start_carry = nl >> 63;
+    ws_carry = ws >> 63;
+  }
+  return done;
+}
+
+size_t dc_split_ws(const uint8_t *line, size_t len, dc_field_view_t **out_fields) {
+  if (out_fields) *out_fields = NULL;
+  if (!out_fields || (!line && len != 0)) return 0;
+
+  dc_field_view_t *v = NULL;
+  size_t cap = 0;
+  size_t cnt = dc_split_ws_into(line, len, 0, &v, &cap);
+  if (cnt == 0 || cnt == (size_t)-1) {
     free(v);
-    *out_fields = NULL;
-    return 0;
+    return cnt;
   }
 
   *out_fields = v;
   return cnt;
 }
+
+size_t dc_trim_span(const uint8_t *p, size_t len, size_t *start) {
+  size_t s = dc_ws_prefix_len(p, len);
+  *start = s;
+  if (s == len) return 0;
+  return len - s - dc_ws_suffix_len(p + s, len - s);
+}
+
+size_t dc_fields_select(dc_sel_t *sel, const uint8_t *line, size_t len, size_t max_fields,
+                        dc_field_view_t **fields, size_t *cap) {
+  size_t n = dc_split_ws_into(line, len, max_fields, fields, cap);
+  if (n == 0 || n == (size_t)-1) return n;
+  return dc_sel_gather(sel, *fields, n);
+}
+
+size_t dc_join(uint8_t *dst, const dc_field_view_t *views, size_t n, uint8_t sep) {
+  size_t w = 0;
+  for (size_t i = 0; i < n; i++) {
+    if (i > 0) {
+      if (dst) dst[w] = sep;
+      w++;
+    }
+    if (dst) memcpy(dst + w, views[i].ptr, views[i].len);
+    w += views[i].len;
+  }
+  return w;
+}
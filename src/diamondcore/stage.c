@@ -0,0 +1,206 @@
+// stage.c - per-line stages for in-process pipelines (`chain`)
+//
+// Each stage takes one borrowed line view and drops it, passes it on
+// unchanged, or replaces it with a view into the stage's own buffer. A
+// view handed on is valid until the stage is applied again, which is all
+// the next stage needs: a chain feeds every line through all stages
+// before reading the next one.
+
+#include "diamondcore.h"
+#include "dc_regex.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+typedef enum {
+  STAGE_LINES,
+  STAGE_MATCH,
+  STAGE_FIELDS,
+  STAGE_TRIM,
+} stage_kind_t;
+
+struct dc_stage {
+  stage_kind_t kind;
+
+  /* lines */
+  dc_sel_t *sel;
+  uint64_t line_no;
+
+  /* match */
+  dc_regex_t *re;
+
+  /* fields (sel is shared with lines) */
+  size_t split_max;
+  dc_field_view_t *fields;
+  size_t fields_cap;
+
+  /* output of transforming stages */
+  uint8_t *buf;
+  size_t buf_cap;
+};
+
+/* "NAME: MSG", dropping the "lines: " the shared SPEC parser puts first. */
+static void stage_err(dc_error_t *err, const char *name, const dc_error_t *sub) {
+  const char *msg = sub->msg;
+  if (strncmp(msg, "lines: ", 7) == 0) msg += 7;
+  dc_err_set(err, sub->code, "%s: %s", name, msg[0] ? msg : "invalid argument");
+}
+
+static bool reserve(dc_stage_t *st, size_t n) {
+  if (n <= st->buf_cap) return true;
+  size_t ncap = st->buf_cap ? st->buf_cap : 256;
+  while (ncap < n) ncap *= 2;
+  uint8_t *nb = (uint8_t *)realloc(st->buf, ncap);
+  if (!nb) return false;
+  st->buf = nb;
+  st->buf_cap = ncap;
+  return true;
+}
+
+bool dc_stage_takes_arg(const char *name) {
+  return strcmp(name, "lines") == 0 || strcmp(name, "match") == 0 || strcmp(name, "fields") == 0;
+}
+
+dc_stage_t *dc_stage_new(const char *name, const char *arg, dc_error_t *err) {
+  dc_err_init(err);
+  dc_stage_t *st = (dc_stage_t *)calloc(1, sizeof(*st));
+  if (!st) {
+    dc_err_set(err, DC_ERR_NOMEM, "out of memory");
+    return NULL;
+  }
+
+  dc_error_t sub;
+  if (strcmp(name, "lines") == 0 || strcmp(name, "fields") == 0) {
+    st->kind = name[0] == 'l' ? STAGE_LINES : STAGE_FIELDS;
+    st->sel = dc_sel_parse_and_normalize(arg, &sub);
+    if (!st->sel) {
+      stage_err(err, name, &sub);
+      free(st);
+      return NULL;
+    }
+    if (st->kind == STAGE_LINES && dc_sel_tail_span(st->sel) > 0) {
+      // A stage sees one line at a time and never the end of the input.
+      dc_err_set(err, DC_ERR_USAGE, "lines: SPEC counted from the end is not supported here");
+      dc_stage_free(st);
+      return NULL;
+    }
+    if (st->kind == STAGE_FIELDS) {
+      bool has_max = false;
+      uint64_t m = dc_sel_max_finite(st->sel, &has_max);
+      if (has_max && m < (uint64_t)SIZE_MAX) st->split_max = (size_t)m;
+    }
+  } else if (strcmp(name, "match") == 0) {
+    char errbuf[256];
+    errbuf[0] = '\0';
+    st->kind = STAGE_MATCH;
+    if (!dc_regex_cache_get(&st->re, arg, errbuf)) {
+      dc_err_set(err, DC_ERR_USAGE, "%s", errbuf[0] ? errbuf : "match: pattern compile error");
+      free(st);
+      return NULL;
+    }
+  } else if (strcmp(name, "trim") == 0) {
+    st->kind = STAGE_TRIM;
+  } else {
+    dc_err_set(err, DC_ERR_USAGE, "unknown stage '%s'", name);
+    free(st);
+    return NULL;
+  }
+  return st;
+}
+
+uint64_t dc_stage_skippable(dc_stage_t *st) {
+  if (!st || st->kind != STAGE_LINES) return 0;
+  uint64_t want = dc_sel_next(st->sel, st->line_no + 1);
+  return want > st->line_no + 1 ? want - st->line_no - 1 : 0;
+}
+
+void dc_stage_skipped(dc_stage_t *st, uint64_t n) {
+  if (st && st->kind == STAGE_LINES) st->line_no += n;
+}
+
+// fields and trim reuse the builtins' per-line transforms (split.c).
+static dc_stage_result_t apply_fields(dc_stage_t *st, dc_line_view_t *line, dc_error_t *err) {
+  size_t nsel = dc_fields_select(st->sel, line->ptr, line->len, st->split_max, &st->fields,
+                                 &st->fields_cap);
+  if (nsel == (size_t)-1) {
+    dc_err_set(err, DC_ERR_NOMEM, "fields: out of memory");
+    return DC_STAGE_ERROR;
+  }
+  if (nsel == 0) return DC_STAGE_DROP;
+
+  size_t len = dc_join(NULL, st->fields, nsel, DC_FIELDS_SEP);
+  if (!reserve(st, len + 1)) { // plus the newline
+    dc_err_set(err, DC_ERR_NOMEM, "fields: out of memory");
+    return DC_STAGE_ERROR;
+  }
+  dc_join(st->buf, st->fields, nsel, DC_FIELDS_SEP);
+  if (line->ends_with_nl) st->buf[len++] = '\n';
+  line->ptr = st->buf;
+  line->len = len;
+  return DC_STAGE_PASS;
+}
+
+static dc_stage_result_t apply_trim(dc_stage_t *st, dc_line_view_t *line, dc_error_t *err) {
+  size_t content_len = line->len - (line->ends_with_nl ? 1 : 0);
+  size_t start = 0;
+  size_t len = dc_trim_span(line->ptr, content_len, &start);
+  if (len == 0) return DC_STAGE_DROP;
+
+  if (start + len == content_len) {
+    // Nothing after the content: the trimmed line is still contiguous.
+    line->ptr += start;
+    line->len -= start;
+    return DC_STAGE_PASS;
+  }
+  if (!line->ends_with_nl) {
+    line->ptr += start;
+    line->len = len;
+    return DC_STAGE_PASS;
+  }
+  if (!reserve(st, len + 1)) {
+    dc_err_set(err, DC_ERR_NOMEM, "trim: out of memory");
+    return DC_STAGE_ERROR;
+  }
+  memcpy(st->buf, line->ptr + start, len);
+  st->buf[len] = '\n';
+  line->ptr = st->buf;
+  line->len = len + 1;
+  return DC_STAGE_PASS;
+}
+
+dc_stage_result_t dc_stage_apply(dc_stage_t *st, dc_line_view_t *line, dc_error_t *err) {
+  switch (st->kind) {
+    case STAGE_LINES: {
+      uint64_t want = dc_sel_next(st->sel, st->line_no + 1);
+      if (want == 0) return DC_STAGE_DONE; // proven no future lines needed
+      st->line_no++;
+      return want == st->line_no ? DC_STAGE_PASS : DC_STAGE_DROP;
+    }
+    case STAGE_MATCH: {
+      // Lines are matched without their terminating '\n'.
+      bool limit = false;
+      size_t n = line->len - (line->ends_with_nl ? 1 : 0);
+      if (dc_regex_match_line(st->re, line->ptr, n, &limit)) return DC_STAGE_PASS;
+      if (limit) {
+        dc_err_set(err, DC_ERR_IO, "match: regex execution limit exceeded");
+        return DC_STAGE_ERROR;
+      }
+      return DC_STAGE_DROP;
+    }
+    case STAGE_FIELDS:
+      return apply_fields(st, line, err);
+    case STAGE_TRIM:
+      return apply_trim(st, line, err);
+  }
+  dc_err_set(err, DC_ERR_INTERNAL, "internal: bad stage");
+  return DC_STAGE_ERROR;
+}
+
+void dc_stage_free(dc_stage_t *st) {
+  if (!st) return;
+  dc_sel_free(st->sel);
+  dc_regex_cache_put(st->re);
+  free(st->fields);
+  free(st->buf);
+  free(st);
+}
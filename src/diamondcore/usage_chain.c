@@ -0,0 +1,13 @@
+// usage_chain.c - usage printer for `chain`
+
+#include "diamondcore.h"
+
+#include <stdio.h>
+
+void dc_print_usage_chain(FILE *out) {
+  if (!out) out = stdout;
+  fputs("usage: chain [-A NAME] STAGE [ARG] [--] [FILE...] [:: STAGE [ARG]]...\n", out);
+  fputs("       chain [-A NAME] --var NAME STAGE [ARG] [:: STAGE [ARG]]...\n", out);
+  fputs("       chain --help\n", out);
+  fputs("STAGE is one of: lines SPEC, match PATTERN, fields SPEC, trim\n", out);
+}
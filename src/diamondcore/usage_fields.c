@@ -11,6 +11,7 @@
 
 void dc_print_usage_fields(FILE *out) {
   if (!out) out = stdout;
-  fputs("usage: fields SPEC [--] [FILE...]\n", out);
+  fputs("usage: fields [-A NAME] SPEC [--] [FILE...]\n", out);
+  fputs("       fields [-A NAME] SPEC --var NAME\n", out);
   fputs("       fields --help\n", out);
 }
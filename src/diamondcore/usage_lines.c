@@ -6,6 +6,8 @@
 
 void dc_print_usage_lines(FILE *out) {
   if (!out) out = stdout;
-  fputs("usage: lines SPEC [--] [FILE...]\n", out);
+  fputs("usage: lines [-A NAME] SPEC [--] [FILE...]\n", out);
+  fputs("       lines [-A NAME] SPEC --var NAME\n", out);
+  fputs("       lines --index [--] FILE...\n", out);
   fputs("       lines --help\n", out);
 }
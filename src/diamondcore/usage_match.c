@@ -4,6 +4,9 @@
 
 void dc_print_usage_match(FILE *out) {
   if (!out) out = stdout;
-  fputs("usage: match PATTERN [--] [FILE...]\n", out);
+  fputs("usage: match [-A NAME] PATTERN [--] [FILE...]\n", out);
+  fputs("       match [-A NAME] PATTERN --var NAME\n", out);
+  fputs("       match [-A NAME] -e PATTERN... | -f FILE... [--] [FILE...]\n", out);
+  fputs("       match --cache-stats | --cache-clear\n", out);
   fputs("       match --help\n", out);
 }
@@ -4,7 +4,8 @@
 
 void dc_print_usage_trim(FILE *out) {
   fprintf(out,
-          "usage: trim [--] [FILE...]\n"
+          "usage: trim [-A NAME] [--] [FILE...]\n"
+          "       trim [-A NAME] --var NAME\n"
           "       trim --help\n"
           "\n"
           "Remove leading and trailing ASCII whitespace from each input line.\n");
@@ -16,20 +16,113 @@ extern "C" {
 #define DC_REGEX_MAX_STEPS            2000000
 
 typedef struct dc_regex dc_regex_t;
+typedef struct dc_regex_ctx dc_regex_ctx_t;
 
 /* Compile PATTERN once; empty pattern is valid. */
 bool dc_regex_compile(dc_regex_t **out_re,
                       const char *pattern,
                       char errbuf[256]);
 
+/* Compile N patterns as one: a line matches if any of them matches it.
+ * Plain literals share an Aho-Corasick automaton, which has no execution
+ * limits, so a set can finish a line on which one of its literals alone
+ * would set *exec_limit_exceeded. The other patterns are combined into
+ * alternations, each with the limits of a single pattern.
+ * N == 1 is dc_regex_compile; N == 0 matches nothing. Free with
+ * dc_regex_free. */
+bool dc_regex_compile_set(dc_regex_t **out_re,
+                          const char *const *patterns,
+                          size_t n,
+                          char errbuf[256]);
+
 void dc_regex_free(dc_regex_t *re);
 
-/* Subject does NOT include newline. */
+/* Subject does NOT include newline.
+ * Uses a match context owned by RE, so calls on one RE must not overlap. */
 bool dc_regex_match_line(const dc_regex_t *re,
                          const uint8_t *subject,
                          size_t subject_len,
                          bool *exec_limit_exceeded);
 
+/* Match context: thread lists, mark array and lazy DFA cache, allocated
+ * once and reused for every line. RE is read-only after compile; give each
+ * thread its own context and call dc_regex_match_line_ctx. */
+dc_regex_ctx_t *dc_regex_ctx_new(const dc_regex_t *re);
+void dc_regex_ctx_free(dc_regex_ctx_t *ctx);
+
+bool dc_regex_match_line_ctx(const dc_regex_t *re,
+                             dc_regex_ctx_t *ctx,
+                             const uint8_t *subject,
+                             size_t subject_len,
+                             bool *exec_limit_exceeded);
+
+/* Block scan: BLOCK holds '\n'-terminated lines (the last may be
+ * unterminated). Finds the first line starting at or after *POS that
+ * dc_regex_match_line would accept, stores its offset and length
+ * (including the '\n') in *LINE_OFF / *LINE_LEN and moves *POS past it.
+ * Returns false when no line matches or on an execution limit; in the
+ * latter case *POS is left at the failing line. Lines that cannot contain
+ * a required literal are skipped without being visited one by one. */
+bool dc_regex_find_line(const dc_regex_t *re,
+                        const uint8_t *block,
+                        size_t block_len,
+                        size_t *pos,
+                        size_t *line_off,
+                        size_t *line_len,
+                        bool *exec_limit_exceeded);
+
+bool dc_regex_find_line_ctx(const dc_regex_t *re,
+                            dc_regex_ctx_t *ctx,
+                            const uint8_t *block,
+                            size_t block_len,
+                            size_t *pos,
+                            size_t *line_off,
+                            size_t *line_len,
+                            bool *exec_limit_exceeded);
+
+/* Parallel block scan: like looping over dc_regex_find_line, calling EMIT
+ * for each matching line (with its '\n') in input order, but the block is
+ * split at line boundaries and scanned by up to NTHREADS worker threads,
+ * each with its own match context. Falls back to a serial scan for small
+ * blocks, NTHREADS < 2, or when threads cannot be started.
+ * Returns false if EMIT returned false or on an execution limit
+ * (*exec_limit_exceeded); lines before the failing one are emitted first. */
+typedef bool (*dc_regex_emit_fn)(void *arg, const uint8_t *line, size_t len);
+
+bool dc_regex_scan_par(const dc_regex_t *re,
+                       const uint8_t *block,
+                       size_t block_len,
+                       int nthreads,
+                       dc_regex_emit_fn emit,
+                       void *arg,
+                       bool *exec_limit_exceeded);
+
+/* Session cache of compiled patterns. It lives in the loaded module, so
+ * it outlasts a single builtin call: a loop running `match "$pat"` parses
+ * and allocates the pattern once.
+ * - dc_regex_cache_get is dc_regex_compile through the cache; give the
+ *   result back with dc_regex_cache_put, never dc_regex_free. Failed
+ *   compiles are not cached.
+ * - Least recently used patterns are freed once the cache holds more than
+ *   DC_REGEX_CACHE_BUDGET bytes (programs, match contexts and their lazy
+ *   DFA states). Patterns in use are never freed early.
+ * - Not thread-safe; the shell calls builtins from one thread. */
+#define DC_REGEX_CACHE_BUDGET ((size_t)8 << 20)
+
+typedef struct {
+  size_t entries;
+  size_t bytes;
+  uint64_t hits;
+  uint64_t misses;
+  uint64_t evictions;
+} dc_regex_cache_stats_t;
+
+bool dc_regex_cache_get(dc_regex_t **out_re, const char *pattern, char errbuf[256]);
+void dc_regex_cache_put(dc_regex_t *re);
+void dc_regex_cache_stats(dc_regex_cache_stats_t *st);
+/* Free every idle pattern and reset the counters. */
+void dc_regex_cache_clear(void);
+
 #ifdef __cplusplus
 }
 #endif
@@ -18,6 +18,9 @@ typedef enum {
 
 typedef struct dc_sel dc_sel_t;
 typedef struct dc_line_reader dc_line_reader_t;
+typedef struct dc_out dc_out_t;
+typedef struct dc_lineidx dc_lineidx_t;
+typedef struct dc_stage dc_stage_t;
 
 typedef struct {
   dc_err_code_t code;
@@ -46,18 +49,133 @@ void dc_print_usage_trim(FILE *out);
 void dc_print_usage_lines(FILE *out);
 void dc_print_usage_fields(FILE *out);
 void dc_print_usage_match(FILE *out);
+void dc_print_usage_chain(FILE *out);
 
-/* Selection (range parser + normalizer) */
+/* Selection (range parser + normalizer)
+ * SPEC "@FILE" reads the items from FILE instead; line breaks separate
+ * items like ','. Dense runs of many ranges get a bitmap, and lookups
+ * elsewhere binary-search the merged ranges.
+ * A bound written "-N" counts from the end (-1 is the last item). Such
+ * items are kept apart until the total is known: dc_sel_wants and
+ * dc_sel_next ignore them until dc_sel_resolve, while dc_sel_wants_at and
+ * dc_sel_gather resolve them on the fly. */
 dc_sel_t *dc_sel_parse_and_normalize(const char *spec, dc_error_t *err);
+/* Largest N of any "-N" bound, or 0 if nothing counts from the end; the
+ * decision for an item more than this far from the end never changes. */
+uint64_t dc_sel_tail_span(const dc_sel_t *sel);
+/* True when every item starts at a "-N" bound and so only the last
+ * dc_sel_tail_span items can be selected. */
+bool dc_sel_tail_only(const dc_sel_t *sel);
+/* Turn "-N" bounds into absolute ones for TOTAL items. */
+void dc_sel_resolve(dc_sel_t *sel, uint64_t total);
+/* Stateless query for item N of TOTAL (or of any TOTAL >= N + span when
+ * the real total is not yet known). */
+bool dc_sel_wants_at(const dc_sel_t *sel, uint64_t n, uint64_t total);
+/* Queries may come in any order; an internal cursor makes increasing
+ * LINE_NO (the streaming case) cheapest. dc_sel_reset rewinds the cursor. */
 bool dc_sel_wants(dc_sel_t *sel, uint64_t line_no);
+void dc_sel_reset(dc_sel_t *sel);
+/* Smallest selected number >= FROM, or 0 if there is none. */
+uint64_t dc_sel_next(dc_sel_t *sel, uint64_t from);
+/* Compact the selected entries of FIELDS[0..NFIELDS) (index 1 = FIELDS[0])
+ * to the front, in order, and return how many there are. "-N" bounds are
+ * resolved against NFIELDS (cached while NFIELDS stays the same). */
+size_t dc_sel_gather(dc_sel_t *sel, dc_field_view_t *fields, size_t nfields);
 uint64_t dc_sel_max_finite(dc_sel_t *sel, bool *has_max);
 void dc_sel_free(dc_sel_t *sel);
 
-/* Line reader (streaming, bytewise) */
+/* Read-only file mappings guarded against truncation
+ * - dc_map_open maps the first LEN (> 0) bytes of FD; false with errno set
+ *   on failure.
+ * - While any mapping is open, SIGBUS from reading a part of it that the
+ *   file no longer covers is caught, in any thread: the rest of the
+ *   mapping then reads as NUL bytes and dc_map_truncated turns true, so
+ *   the owner can report an I/O error instead of the process dying.
+ * - dc_map_close unmaps; the previous SIGBUS action is restored when the
+ *   last mapping is closed.
+ */
+typedef struct {
+  const uint8_t *ptr;
+  size_t len;
+  int slot;
+} dc_map_t;
+bool dc_map_open(dc_map_t *m, int fd, size_t len);
+bool dc_map_truncated(const dc_map_t *m);
+void dc_map_close(dc_map_t *m);
+
+/* Line reader (streaming, bytewise)
+ * - Non-empty regular FILEs are mmap'ed and lines are slices of the mapping.
+ * - stdin, '-', pipes and other sources are read in large blocks with
+ *   read(2); no per-line copy.
+ * - The view returned by dc_lr_next points into the reader's buffer and is
+ *   valid only until the next dc_lr_next or dc_lr_close call.
+ */
 dc_line_reader_t *dc_lr_open(char *const *files, size_t file_count, dc_error_t *err);
+/* Reader over in-memory text: SRCS[0..n) are read in order as if each
+ * were a file holding those bytes. Views point into the caller's memory,
+ * which must stay unchanged until dc_lr_close. */
+dc_line_reader_t *dc_lr_open_mem(const dc_field_view_t *srcs, size_t n, dc_error_t *err);
 bool dc_lr_next(dc_line_reader_t *lr, dc_line_view_t *out, dc_error_t *err);
 void dc_lr_close(dc_line_reader_t *lr);
 
+/* Block variant of dc_lr_next: returns every complete line currently
+ * available (the whole file when it is mapped) as one view. A block holds
+ * at least one line, never spans two input files, and only its last line
+ * may lack a '\n' (ends_with_nl describes that line). Same lifetime rules
+ * as dc_lr_next; both may be mixed on one reader. */
+bool dc_lr_next_block(dc_line_reader_t *lr, dc_line_view_t *out, dc_error_t *err);
+/* False with ERR set once the mapped file being read shrank under the
+ * reader (see dc_map_open); views handed out since may then hold NUL
+ * bytes where the lost data was. The dc_lr_* calls check this themselves,
+ * so it is for callers that go on reading a block after receiving it. */
+bool dc_lr_intact(const dc_line_reader_t *lr, dc_error_t *err);
+
+/* Skip up to N lines, continuing into later FILEs as dc_lr_next would.
+ * *SKIPPED receives the number actually skipped (< N only at EOF).
+ * Returns false only on error. */
+bool dc_lr_skip(dc_line_reader_t *lr, uint64_t n, uint64_t *skipped, dc_error_t *err);
+/* True when every input is a named regular file, so the input can be
+ * read again or scanned from its end (never for in-memory text). */
+bool dc_lr_inputs_regular(const dc_line_reader_t *lr);
+/* On a reader that has not been read yet and whose inputs are all regular
+ * files: scan backward from the end and position the reader at the first
+ * of the last N lines. *FOUND is N, or the total line count if smaller.
+ * Returns false with ERR set on an I/O error. */
+bool dc_lr_seek_tail(dc_line_reader_t *lr, uint64_t n, uint64_t *found, dc_error_t *err);
+
+/* Let the reader consult FILE.dcidx sidecar indexes (see below) when
+ * skipping lines. Off by default. */
+void dc_lr_use_index(dc_line_reader_t *lr, bool on);
+
+/* Called right before each read(2) the reader issues, i.e. whenever it may
+ * block waiting for input. Returning false aborts dc_lr_next with ERR. */
+typedef bool (*dc_lr_refill_fn)(void *arg, dc_error_t *err);
+void dc_lr_set_refill_hook(dc_line_reader_t *lr, dc_lr_refill_fn fn, void *arg);
+
+/* Output writer (buffered, shared by the builtins)
+ * - Writes to fileno(FP) (stdout if NULL) through a private buffer;
+ *   FP itself is flushed on open so earlier shell output comes first.
+ * - Write failures (EPIPE, EBADF, ...) set err to DC_ERR_IO and are sticky:
+ *   every later call fails the same way.
+ * - dc_out_close flushes and frees; it returns false if anything failed.
+ */
+dc_out_t *dc_out_open(FILE *fp, dc_error_t *err);
+bool dc_out_write(dc_out_t *out, const void *p, size_t n, dc_error_t *err);
+bool dc_out_putc(dc_out_t *out, uint8_t c, dc_error_t *err);
+/* Write VIEWS[0..n) separated by SEP (no trailing separator). */
+bool dc_out_join(dc_out_t *out, const dc_field_view_t *views, size_t n,
+                 uint8_t sep, dc_error_t *err);
+bool dc_out_flush(dc_out_t *out, dc_error_t *err);
+bool dc_out_close(dc_out_t *out, dc_error_t *err);
+
+/* Line sink: instead of a file, the writer passes each output line to FN,
+ * without its '\n' and NUL-terminated (LINE is only valid during the
+ * call). Lines are passed on in batches as the buffer fills, on
+ * dc_out_flush, and on dc_out_close, which also passes a final
+ * unterminated line. FN returning false fails the write with its ERR. */
+typedef bool (*dc_out_line_fn)(void *arg, const uint8_t *line, size_t len, dc_error_t *err);
+dc_out_t *dc_out_open_lines(dc_out_line_fn fn, void *arg, dc_error_t *err);
+
 /* Split a line into non-empty fields separated by ASCII whitespace.
  * - Returns number of fields.
  * - On success, *out_fields points to heap array of views into line buffer (no copies). Caller free().
@@ -67,4 +185,79 @@ void dc_lr_close(dc_line_reader_t *lr);
  */
 size_t dc_split_ws(const uint8_t *line, size_t len, dc_field_view_t **out_fields);
 
+/* Same splitting into a caller-owned array that is reused across calls.
+ * - *fields / *cap describe the array (NULL / 0 to start); it is grown with
+ *   realloc when needed and stays owned by the caller, also on failure.
+ * - Stops scanning once MAX_FIELDS fields were found (0 = no limit).
+ * - Returns the number of fields stored, or (size_t)-1 on allocation failure.
+ */
+size_t dc_split_ws_into(const uint8_t *line, size_t len, size_t max_fields,
+                        dc_field_view_t **fields, size_t *cap);
+
+/* Length of the run of ASCII whitespace (as for dc_split_ws) at the
+ * start / end of P[0..len), scanned 64 bytes at a time. */
+size_t dc_ws_prefix_len(const uint8_t *p, size_t len);
+size_t dc_ws_suffix_len(const uint8_t *p, size_t len);
+/* Length of the leading run of complete lines of P[0..len) (P starts a
+ * line) that are non-empty and neither start nor end with whitespace,
+ * i.e. lines trimming would leave unchanged. */
+size_t dc_trimmed_lines_len(const uint8_t *p, size_t len);
+
+/* The per-line transforms of `trim` and `fields`, shared by the builtins
+ * and their `chain` stages so both always agree.
+ * - dc_trim_span: for a line's content P[0..len) (without its '\n'),
+ *   store the offset of the first byte kept in *START and return the
+ *   length kept; 0 means the line is dropped.
+ * - dc_fields_select: split LINE as dc_split_ws_into does (stopping after
+ *   MAX_FIELDS, 0 = no limit) and compact the fields SEL selects to the
+ *   front of *FIELDS. Returns how many, or (size_t)-1 on allocation
+ *   failure.
+ * - dc_join: write VIEWS[0..n) separated by SEP (no trailing separator)
+ *   to DST and return the length; a NULL DST only measures. Selected
+ *   fields are joined with DC_FIELDS_SEP. */
+#define DC_FIELDS_SEP ((uint8_t)' ')
+size_t dc_trim_span(const uint8_t *p, size_t len, size_t *start);
+size_t dc_fields_select(dc_sel_t *sel, const uint8_t *line, size_t len, size_t max_fields,
+                        dc_field_view_t **fields, size_t *cap);
+size_t dc_join(uint8_t *dst, const dc_field_view_t *views, size_t n, uint8_t sep);
+
+/* Sidecar line index: PATH.dcidx holds the byte offset of every 1024th
+ * line of PATH plus its line count, keyed by device, inode, size and
+ * mtime. A stale or malformed index is never used.
+ * - dc_lineidx_build writes (or replaces) the index of PATH.
+ * - dc_lineidx_load returns NULL unless a valid index for the open FD exists.
+ * - dc_lineidx_seek finds the last sampled line <= LINE (0-based).
+ */
+bool dc_lineidx_build(const char *path, dc_error_t *err);
+dc_lineidx_t *dc_lineidx_load(const char *path, int fd);
+uint64_t dc_lineidx_lines(const dc_lineidx_t *idx);
+bool dc_lineidx_seek(const dc_lineidx_t *idx, uint64_t line, uint64_t *line_at, uint64_t *off);
+void dc_lineidx_free(dc_lineidx_t *idx);
+
+/* Pipeline stages: the per-line core of lines, match, fields and trim,
+ * for running several of them in one process.
+ * - dc_stage_new takes the builtin NAME and its SPEC / PATTERN (ignored for
+ *   trim; see dc_stage_takes_arg). lines SPECs counted from the end are
+ *   rejected, as a stage never sees the end of its input.
+ * - dc_stage_apply filters or rewrites *LINE in place. A rewritten view
+ *   points into the stage and is valid until its next dc_stage_apply.
+ *   DC_STAGE_DONE means this and every later line is dropped.
+ * - dc_stage_skippable is how many coming lines a first stage drops
+ *   unseen; the caller may skip them in the reader and report the count
+ *   with dc_stage_skipped.
+ */
+typedef enum {
+  DC_STAGE_DROP,
+  DC_STAGE_PASS,
+  DC_STAGE_DONE,
+  DC_STAGE_ERROR,
+} dc_stage_result_t;
+
+bool dc_stage_takes_arg(const char *name);
+dc_stage_t *dc_stage_new(const char *name, const char *arg, dc_error_t *err);
+dc_stage_result_t dc_stage_apply(dc_stage_t *st, dc_line_view_t *line, dc_error_t *err);
+uint64_t dc_stage_skippable(dc_stage_t *st);
+void dc_stage_skipped(dc_stage_t *st, uint64_t n);
+void dc_stage_free(dc_stage_t *st);
+
 #endif /* DIAMONDCORE_H */
@@ -0,0 +1,121 @@
+#!/usr/bin/env bats
+# tests/chain.bats
+
+setup() {
+  ROOT="${BATS_TEST_DIRNAME}/.."
+  BUILD="${BUILD:-$ROOT/build}"
+  CHAIN_SO="${CHAIN_SO:-$BUILD/chain.debug.so}"
+
+  for so in "$CHAIN_SO" "$BUILD/lines.debug.so" "$BUILD/match.debug.so" \
+            "$BUILD/fields.debug.so" "$BUILD/trim.debug.so"; do
+    if [[ ! -f "$so" ]]; then
+      echo "missing so: $so" >&2
+      return 2
+    fi
+  done
+
+  TMPDIR="${BATS_TEST_TMPDIR:-/tmp}"
+  F1="$TMPDIR/chain_f1.txt"
+  F2="$TMPDIR/chain_f2.txt"
+}
+
+# Run `chain ARGS...` with stdin from the file given first.
+run_chain() {
+  local in="$1"
+  shift
+  run bash --noprofile --norc -c '
+    so="$1"; in="$2"; shift 2
+    enable -f "$so" chain || exit 99
+    chain "$@" < "$in"
+  ' _ "$CHAIN_SO" "$in" "$@"
+}
+
+# Compare `chain ...` with the equivalent pipeline of the standalone
+# builtins; the pipeline is given as a string over the same input.
+same_as_pipeline() {
+  local in="$1" pipeline="$2"
+  shift 2
+  run bash --noprofile --norc -c '
+    b="$1"; in="$2"; pipeline="$3"; shift 3
+    for n in lines match fields trim; do enable -f "$b/$n.debug.so" "$n" || exit 99; done
+    enable -f "$b/chain.debug.so" chain || exit 99
+    diff <(eval "$pipeline" < "$in" | od -An -tx1) <(chain "$@" < "$in" | od -An -tx1)
+  ' _ "$BUILD" "$in" "$pipeline" "$@"
+  [ "$status" -eq 0 ]
+}
+
+@test "chain: lines :: match :: fields :: trim equals the pipeline" {
+  printf '  a 1 x \nb 2 y\n  a3 3 z\t\nfoo\n a 4' > "$F1"
+  same_as_pipeline "$F1" "lines 1..5 | match a | fields 2 | trim" \
+    lines 1..5 :: match a :: fields 2 :: trim
+  same_as_pipeline "$F1" "trim | fields 1,3" trim :: fields 1,3
+}
+
+@test "chain: trim and fields stages agree with the builtins on odd whitespace" {
+  {
+    printf '\v\f a\r\t\n'
+    printf ' \t \r\n'
+    printf '%*s%s%*s\n' 100 '' 'wide padding' 100 ''
+    printf 'x\fy\vz  w\r\n'
+    printf '%s ' $(seq 1 40); printf '\n'
+    printf '\t  last'
+  } > "$F1"
+  same_as_pipeline "$F1" "trim" trim
+  same_as_pipeline "$F1" "fields 2,-1" fields 2,-1
+  same_as_pipeline "$F1" "fields 3..5 | trim" fields 3..5 :: trim
+}
+
+@test "chain: a later lines stage numbers the lines it receives" {
+  seq 1 200 > "$F1"
+  run_chain "$F1" match 7 :: lines 2..4
+  [ "$status" -eq 0 ]
+  [ "$output" = $'17\n27\n37' ]
+}
+
+@test "chain: leading lines stage skips and stops early" {
+  seq 1 100000 > "$F1"
+  run_chain "$F1" lines 50000,99999..99999 :: match 9
+  [ "$status" -eq 0 ]
+  [ "$output" = "99999" ]
+}
+
+@test "chain: FILE operands and - in the first stage" {
+  printf 'a x\n' > "$F1"
+  printf 'b y\n' > "$F2"
+  run bash --noprofile --norc -c '
+    enable -f "$1" chain || exit 99
+    printf "c z\n" | chain fields 2 "$2" - "$3"
+  ' _ "$CHAIN_SO" "$F1" "$F2"
+  [ "$status" -eq 0 ]
+  [ "$output" = $'x\nz\ny' ]
+}
+
+@test "chain: exit 1 when nothing reaches the end" {
+  printf 'a\nb\n' > "$F1"
+  run_chain "$F1" match a :: match b
+  [ "$status" -eq 1 ]
+  [ "$output" = "" ]
+}
+
+@test "chain: usage errors exit 2" {
+  printf 'a\n' > "$F1"
+  run_chain "$F1"
+  [ "$status" -eq 2 ]
+  run_chain "$F1" lines 1 ::
+  [ "$status" -eq 2 ]
+  [[ "$output" == *"empty stage"* ]]
+  run_chain "$F1" sort
+  [ "$status" -eq 2 ]
+  run_chain "$F1" match
+  [ "$status" -eq 2 ]
+  [[ "$output" == *"missing PATTERN"* ]]
+  run_chain "$F1" trim :: lines 1 "$F1"
+  [ "$status" -eq 2 ]
+  run_chain "$F1" lines -2
+  [ "$status" -eq 2 ]
+  run_chain "$F1" fields 0
+  [ "$status" -eq 2 ]
+  [[ "$output" == "chain: fields: "* ]]
+  run_chain "$F1" trim -x
+  [ "$status" -eq 2 ]
+}
@@ -55,6 +55,16 @@ run_fields_od() {
   [ "$output" = $'a c' ]
 }
 
+@test "fields: selection applies to every line, not just the first" {
+  run_fields "1,3" $'a b c d\ne f g h\ni j\nk l m\n'
+  [ "$status" -eq 0 ]
+  [ "$output" = $'a c\ne g\ni\nk m' ]
+
+  run_fields "2.." $'a b c\nd e\nf\n'
+  [ "$status" -eq 0 ]
+  [ "$output" = $'b c\ne' ]
+}
+
 @test "fields: closed range 2..3" {
   run_fields "2..3" $'a b c d\n'
   [ "$status" -eq 0 ]
@@ -97,6 +107,27 @@ run_fields_od() {
   [ "$output" = $'a c' ]
 }
 
+@test "fields: every ASCII whitespace byte separates, across long lines" {
+  run_fields "2,4" $'a\vb\fc\rd\n'
+  [ "$status" -eq 0 ]
+  [ "$output" = $'b d' ]
+
+  # Fields straddling 64-byte block boundaries.
+  local long="" i
+  for ((i = 1; i <= 40; i++)); do long+="f$i${i:0:1}xyz "; done
+  run_fields "13..15,40" "$long"$'\n'
+  [ "$status" -eq 0 ]
+  [ "$output" = "f131xyz f141xyz f151xyz f404xyz" ]
+}
+
+@test "fields: leading fields of a wide record" {
+  local wide="" i
+  for ((i = 1; i <= 300; i++)); do wide+="c$i "; done
+  run_fields_od "1..2" "$wide"$'\n'
+  [ "$status" -eq 0 ]
+  [ "$output" = " 63 31 20 63 32 0a" ]
+}
+
 @test "fields: empty/whitespace-only lines produce no output lines" {
   run_fields "1" $'\n   \t\nA B\n\t\n'
   [ "$status" -eq 0 ]
@@ -264,3 +295,63 @@ run_fields_od() {
   [ "$status" -eq 0 ]
   [ "$output" = $'a b' ]
 }
+
+@test "fields: -N counts from the last field of each line" {
+  run_fields "-1" $'a b c\nx y\n\nz\n'
+  [ "$status" -eq 0 ]
+  [ "$output" = $'c\ny\nz' ]
+
+  run_fields "-2.." $'a b c d\nx\n'
+  [ "$status" -eq 0 ]
+  [ "$output" = $'c d\nx' ]
+
+  run_fields "2..-2,-1" $'a b c d e\nx y\n'
+  [ "$status" -eq 0 ]
+  [ "$output" = $'b c d e\ny' ]
+}
+
+@test "fields: -0 and backwards -a..-b are invalid (exit 2)" {
+  run_fields "-0" $'a b\n'
+  [ "$status" -eq 2 ]
+  run_fields "-1..-2" $'a b\n'
+  [ "$status" -eq 2 ]
+}
+
+@test "fields: -A NAME fills an array; bad NAME is exit 2" {
+  run bash --noprofile --norc -c '
+    enable -f "$1" fields || exit 99
+    fields -A arr 2 < <(printf "a b\nc\nd e\n") || exit $?
+    declare -p arr
+  ' _ "$FIELDS_SO"
+  [ "$status" -eq 0 ]
+  [[ "$output" == *'arr=([0]="b" [1]="e")'* ]]
+
+  run bash --noprofile --norc -c '
+    enable -f "$1" fields || exit 99
+    declare -A as
+    fields -A as 1 <<< a
+  ' _ "$FIELDS_SO"
+  [ "$status" -eq 2 ]
+
+  run bash --noprofile --norc -c 'enable -f "$1" fields || exit 99; fields 1 -A' _ "$FIELDS_SO"
+  [ "$status" -eq 2 ]
+}
+
+@test "fields: output is flushed before waiting for more input" {
+  # The writer keeps the FIFO open, so fields must hand over the first line
+  # while it is still waiting for the second (as with `tail -f log | fields`).
+  run bash --noprofile --norc -c "
+    enable -f '$FIELDS_SO' fields || exit 99
+    cd '$BATS_TEST_TMPDIR' && mkfifo fields_in fields_out || exit 98
+    exec 3<>fields_in
+    fields 2 <fields_in >fields_out 3>&- &
+    exec 4<fields_out
+    printf 'x y z\\n' >&3
+    IFS= read -r -t 5 line <&4 || line=timeout
+    exec 3>&-
+    wait
+    printf '%s\\n' \"\$line\"
+  "
+  [ "$status" -eq 0 ]
+  [ "$output" = "y" ]
+}
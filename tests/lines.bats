@@ -284,3 +284,250 @@ run_lines() {
   "
   [ "$status" -eq 2 ]
 }
+
+@test "lines: line longer than the read block is emitted intact" {
+  awk 'BEGIN { printf "a\n"; for (i=0;i<300000;i++) printf "x"; printf "\nc\n" }' >"$F1"
+
+  run bash --noprofile --norc -c "
+    enable -f '$LINES_SO' lines || exit 99
+    lines 2 '$F1' | wc -c
+  "
+  [ "$status" -eq 0 ]
+  [ "$output" -eq 300001 ]
+}
+
+@test "lines: seekable stdin resumes after the last consumed line" {
+  printf 'a\nb\nc\n' >"$F1"
+
+  run bash --noprofile --norc -c "
+    enable -f '$LINES_SO' lines || exit 99
+    { lines 1; lines 1; } <'$F1'
+  "
+  [ "$status" -eq 0 ]
+  [ "$output" = $'a\nb' ]
+}
+
+@test "lines: unterminated last line of a file stays a separate line" {
+  printf 'a\nb' >"$F1"
+  printf 'c\n' >"$F2"
+
+  run bash --noprofile --norc -c "
+    enable -f '$LINES_SO' lines || exit 99
+    lines 2..3 '$F1' '$F2' | od -An -tx1
+  "
+  [ "$status" -eq 0 ]
+  [ "$(echo $output)" = "62 63 0a" ]
+}
+
+@test "lines: --index builds a sidecar index used for seeking" {
+  awk 'BEGIN { for (i=1;i<=5000;i++) print "l" i }' >"$F1"
+  awk 'BEGIN { for (i=1;i<=3000;i++) print "m" i; printf "end" }' >"$F2"
+
+  run bash --noprofile --norc -c "
+    enable -f '$LINES_SO' lines || exit 99
+    lines --index '$F1' '$F2' && lines 1024,1025,4999..5001,7048,8001 '$F1' '$F2'
+  "
+  [ "$status" -eq 0 ]
+  [ "$output" = $'l1024\nl1025\nl4999\nl5000\nm1\nm2048\nend' ]
+  [ -f "$F1.dcidx" ]
+}
+
+@test "lines: a stale index is ignored" {
+  awk 'BEGIN { for (i=1;i<=3000;i++) print "l" i }' >"$F1"
+
+  run bash --noprofile --norc -c "
+    enable -f '$LINES_SO' lines || exit 99
+    lines --index '$F1' || exit 98
+    awk 'BEGIN { for (i=1;i<=3000;i++) print \"new\" i }' >'$F1'
+    lines 2500 '$F1'
+  "
+  [ "$status" -eq 0 ]
+  [ "$output" = "new2500" ]
+}
+
+@test "lines: --index needs a FILE and fails on a missing one" {
+  run bash --noprofile --norc -c "
+    enable -f '$LINES_SO' lines || exit 99
+    lines --index
+  "
+  [ "$status" -eq 2 ]
+
+  run bash --noprofile --norc -c "
+    enable -f '$LINES_SO' lines || exit 99
+    lines --index '$TMPDIR/no_such_file'
+  "
+  [ "$status" -eq 2 ]
+}
+
+@test "lines: skipping counts lines exactly on pipes and files" {
+  awk 'BEGIN { for (i=1;i<=200000;i++) { if (i % 7 == 0) printf "%0300d\n", i; else print "r" i } }' >"$F1"
+  printf 'a\n\nb' >"$F2"
+
+  run bash --noprofile --norc -c "
+    enable -f '$LINES_SO' lines || exit 99
+    cat '$F1' | lines 150000,150001,199999 | cut -c1-8
+  "
+  [ "$status" -eq 0 ]
+  [ "$output" = $'r150000\nr150001\nr199999' ]
+
+  run bash --noprofile --norc -c "
+    enable -f '$LINES_SO' lines || exit 99
+    lines 199997..200000,200002,200003 '$F1' '$F2' | cut -c1-8
+  "
+  [ "$status" -eq 0 ]
+  [ "$output" = $'00000000\nr199998\nr199999\nr200000\n\nb' ]
+}
+
+@test "lines: -N.. and -N count from the end of the input" {
+  awk 'BEGIN { for (i=1;i<=3000;i++) print "l" i }' >"$F1"
+  printf 'x\ny' >"$F2"
+
+  run bash --noprofile --norc -c "
+    enable -f '$LINES_SO' lines || exit 99
+    lines -3.. '$F1' '$F2'; echo =; lines -- -2 '$F1'; echo =; lines -3..-2 '$F2' '$F1'
+  "
+  [ "$status" -eq 0 ]
+  [ "$output" = $'l3000\nx\ny=\nl2999\n=\nl2998\nl2999' ]
+
+  run bash --noprofile --norc -c "
+    enable -f '$LINES_SO' lines || exit 99
+    cat '$F1' | lines -3..; echo =; printf 'a\nb\n' | lines -5..
+  "
+  [ "$status" -eq 0 ]
+  [ "$output" = $'l2998\nl2999\nl3000\n=\na\nb' ]
+}
+
+@test "lines: mixed absolute and end-relative bounds" {
+  printf '1\n2\n3\n4\n5\n6\n' >"$F1"
+
+  run bash --noprofile --norc -c "
+    enable -f '$LINES_SO' lines || exit 99
+    lines 2..-4,-1 '$F1'; echo =; cat '$F1' | lines 2..-4,-1; echo =; cat '$F1' | lines -5..2
+  "
+  [ "$status" -eq 0 ]
+  [ "$output" = $'2\n3\n6\n=\n2\n3\n6\n=\n2' ]
+}
+
+@test "lines: -N past the start selects nothing (exit 1)" {
+  run_lines "-4" $'a\nb\nc\n'
+  [ "$status" -eq 1 ]
+  [ -z "$output" ]
+
+  run_lines "-0" $'a\n'
+  [ "$status" -eq 2 ]
+}
+
+@test "lines: @FILE reads SPEC from a file" {
+  awk 'BEGIN { for (i=1;i<=5000;i++) print "l" i }' >"$F1"
+  printf '4990\n\n  7 , 3\n100..102\r\n-1\n' >"$F2"
+
+  run bash --noprofile --norc -c "
+    enable -f '$LINES_SO' lines || exit 99
+    lines @'$F2' '$F1'
+  "
+  [ "$status" -eq 0 ]
+  [ "$output" = $'l3\nl7\nl100\nl101\nl102\nl4990\nl5000' ]
+
+  # A long list of discrete numbers, queried out of a dense cluster.
+  awk 'BEGIN { for (i=4999;i>=1;i-=3) print i }' >"$F2"
+  run bash --noprofile --norc -c "
+    enable -f '$LINES_SO' lines || exit 99
+    lines @'$F2' '$F1' | md5sum
+  "
+  [ "$status" -eq 0 ]
+  [ "$output" = "$(awk 'NR % 3 == 1' "$F1" | md5sum)" ]
+}
+
+@test "lines: unreadable or empty @FILE is a usage error (exit 2)" {
+  run_lines "@$TMPDIR/no_such_spec" $'a\n'
+  [ "$status" -eq 2 ]
+
+  : >"$F2"
+  run_lines "@$F2" $'a\n'
+  [ "$status" -eq 2 ]
+}
+
+@test "lines: -A NAME stores the selected lines in an array" {
+  printf 'a\n\nc\nd' > "$F1"
+  run bash --noprofile --norc -c "
+    enable -f '$LINES_SO' lines || exit 99
+    arr=(stale stale stale stale stale)
+    lines -A arr 2.. '$F1' || exit \$?
+    echo \"\${#arr[@]}\"
+    printf '<%s>' \"\${arr[@]}\"
+  "
+  [ "$status" -eq 0 ]
+  [ "$output" = $'3\n<><c><d>' ]
+}
+
+@test "lines: --var NAME reads a string or array variable" {
+  run bash --noprofile --norc -c "
+    enable -f '$LINES_SO' lines || exit 99
+    s=\$'a\nb\nc'
+    lines 2.. --var s
+    echo '|'
+    arr=(x 'y z' '' w)
+    lines --var arr 2..3
+    lines -A arr 3..4 --var arr
+    echo \"\${#arr[@]}:\${arr[1]}\"
+  "
+  [ "$status" -eq 0 ]
+  [ "$output" = $'b\nc|\ny z\n\n2:w' ]
+}
+
+@test "lines: --var errors are exit 2" {
+  printf 'a\n' > "$F1"
+  run bash --noprofile --norc -c "
+    enable -f '$LINES_SO' lines || exit 99
+    s=a
+    lines 1 --var s '$F1'
+  "
+  [ "$status" -eq 2 ]
+  run bash --noprofile --norc -c "
+    enable -f '$LINES_SO' lines || exit 99
+    lines 1 --var no_such_var
+  "
+  [ "$status" -eq 2 ]
+}
+
+@test "lines: a file truncated while mapped is a read error, not SIGBUS" {
+  seq 1 2000000 > "$F1"
+  run bash --noprofile --norc -c "
+    enable -f '$LINES_SO' lines || exit 99
+    lines 1.. '$F1' > >(head -c 4096 >/dev/null; : > '$F1'; cat >/dev/null) || echo \"rc=\$?\"
+    echo alive
+  "
+  [ "$status" -eq 0 ]
+  [ "$output" = "lines: read error: '$F1' shrank while being read"$'\nrc=2\nalive' ]
+}
+
+@test "lines: a SIGBUS sent while a file is mapped still reaches the shell" {
+  seq 1 2000000 > "$F1"
+  run bash --noprofile --norc -c "
+    enable -f '$LINES_SO' lines || exit 99
+    trap 'echo trapped' BUS
+    lines 1.. '$F1' > >(head -c 4096 >/dev/null; kill -BUS \$\$; sleep 0.2; : > '$F1'; cat >/dev/null) || echo \"rc=\$?\"
+    echo alive
+  "
+  [ "$status" -eq 0 ]
+  [ "$output" = "lines: read error: '$F1' shrank while being read"$'\ntrapped\nrc=2\nalive' ]
+}
+
+@test "lines: output is flushed before waiting for more input" {
+  # The writer keeps the FIFO open, so lines must hand over the first line
+  # while it is still waiting for the second (as with `tail -f log | lines`).
+  run bash --noprofile --norc -c "
+    enable -f '$LINES_SO' lines || exit 99
+    cd '$BATS_TEST_TMPDIR' && mkfifo lines_in lines_out || exit 98
+    exec 3<>lines_in
+    lines 1.. <lines_in >lines_out 3>&- &
+    exec 4<lines_out
+    printf 'first\\n' >&3
+    IFS= read -r -t 5 line <&4 || line=timeout
+    exec 3>&-
+    wait
+    printf '%s\\n' \"\$line\"
+  "
+  [ "$status" -eq 0 ]
+  [ "$output" = "first" ]
+}
@@ -172,3 +172,174 @@ bash_with_match() {
   size="$(wc -c < "$tmp" | tr -d " ")"
   [ "$size" -ge 200000 ]
 }
+
+@test "match: matched lines are written before waiting for more input" {
+  out="$BATS_TEST_TMPDIR/match_prompt_$$.out"
+
+  run bash -c '
+    enable -f "$BASH_BUILTINS_DIR/match.debug.so" match
+    { printf "hit\nmiss\n"; sleep 2; } | match hit > "'"$out"'" &
+    sleep 1
+    cat "'"$out"'"
+    wait
+  '
+  [ "$status" -eq 0 ]
+  [ "$output" = "hit" ]
+}
+
+@test "match: execution limit is reported on a pathological line" {
+  run bash -c '
+    enable -f "$BASH_BUILTINS_DIR/match.debug.so" match
+    awk "BEGIN { for (i=0;i<100000;i++) printf \"a\"; printf \"\\n\" }" | match "(a|aa)*(a|aa)*b"
+  '
+  [ "$status" -eq 2 ]
+  [ "$output" = "match: regex execution limit exceeded" ]
+}
+
+@test "match: required literals and anchored prefixes" {
+  run bash -c '
+    enable -f "$BASH_BUILTINS_DIR/match.debug.so" match
+    printf "ERROR disk timeout\nERROR ok\ntimeout\n" | match "ERROR.*timeout"
+  '
+  [ "$status" -eq 0 ]
+  [ "$output" = "ERROR disk timeout" ]
+
+  run bash -c '
+    enable -f "$BASH_BUILTINS_DIR/match.debug.so" match
+    printf "GET /api/x\nPOST /api\n GET /api\nGET /ap\n" | match "^GET /api"
+  '
+  [ "$status" -eq 0 ]
+  [ "$output" = "GET /api/x" ]
+}
+
+@test "match: short patterns agree on empty matches, \$ and long lines" {
+  run bash_with_match 'printf "x\n\nbb\n" | match "a*\$"'
+  [ "$status" -eq 0 ]
+  [ "$output" = $'x\n\nbb' ]
+
+  run bash_with_match 'printf "c\nbcc\nbbc\n\nabe\n" | match "^b?c+\$"'
+  [ "$status" -eq 0 ]
+  [ "$output" = $'c\nbcc' ]
+
+  run bash_with_match 'printf "abe\ncde\nade\nxxcdey\nce\n" | match "(ab|c)d?e"'
+  [ "$status" -eq 0 ]
+  [ "$output" = $'abe\ncde\nxxcdey\nce' ]
+
+  # Far past the length the bit-parallel engine takes.
+  run bash_with_match 'awk "BEGIN { for (i=0;i<200000;i++) printf \"a\"; print \"b\"; print \"ab\" }" | match "^a+b\$" | wc -l'
+  [ "$status" -eq 0 ]
+  [ "$output" -eq 2 ]
+}
+
+@test "match: an unterminated last line does not run into the next file" {
+  a="$BATS_TEST_TMPDIR/match_blk_a_$$"
+  b="$BATS_TEST_TMPDIR/match_blk_b_$$"
+  awk 'BEGIN { for (i=0;i<5000;i++) print "noise " i; printf "tail err" }' > "$a"
+  printf "or\nmore\n" > "$b"
+
+  run bash_with_match 'match rror "'"$a"'" "'"$b"'"'
+  [ "$status" -eq 1 ]
+  [ -z "$output" ]
+
+  run bash_with_match 'match "^or$" "'"$a"'" "'"$b"'"'
+  [ "$status" -eq 0 ]
+  [ "$output" = "or" ]
+}
+
+@test "match: threaded scan of a large file gives the serial output" {
+  in="$BATS_TEST_TMPDIR/match_par_in_$$"
+  awk 'BEGIN { for (i=0;i<400000;i++) printf "line %d %s\n", i, (i % 7 == 0 ? "hit" : "miss") }' > "$in"
+  printf "tail hit" >> "$in"
+
+  run bash_with_match 'MATCH_THREADS=4 match "hit$" "'"$in"'" | cksum'
+  [ "$status" -eq 0 ]
+  par="$output"
+
+  run bash_with_match 'MATCH_THREADS=1 match "hit$" "'"$in"'" | cksum'
+  [ "$status" -eq 0 ]
+  [ "$output" = "$par" ]
+}
+
+@test "match: -A NAME collects matching lines; no match leaves it empty" {
+  # Input is redirected, not piped: a pipeline runs match in a subshell.
+  run bash_with_match 'match -A hits "^ba" < <(printf "foo\nbar\nbaz"); echo "${hits[*]}"
+    hits=(x); match -A hits z <<< foo || echo "rc=$? n=${#hits[@]}"'
+  [ "$status" -eq 0 ]
+  [ "$output" = $'bar baz\nrc=1 n=0' ]
+}
+
+@test "match: --var NAME matches in a shell variable" {
+  run bash_with_match 's=$'"'"'foo\nbar\nbaz'"'"'; match --var s "^ba"; e=; match --var e . || echo "rc=$?"'
+  [ "$status" -eq 0 ]
+  [ "$output" = $'bar\nbazrc=1' ]
+}
+
+@test "match: compiled patterns are cached across calls" {
+  run bash_with_match 'for i in 1 2 3; do match "b+" <<< abc; done; match --cache-stats; match --cache-clear; match --cache-stats | head -1'
+  [ "$status" -eq 0 ]
+  [ "${lines[3]}" = "entries 1" ]
+  [ "${lines[5]}" = "hits 2" ]
+  [ "${lines[6]}" = "misses 1" ]
+  [ "${lines[8]}" = "entries 0" ]
+}
+
+@test "match: -e and -f select lines matching any pattern" {
+  printf 'qux\n^ba.$\n' > "$BATS_TEST_TMPDIR/match_pats"
+  printf 'foo\nbar\nbaz\nqux\nbazz\n' > "$BATS_TEST_TMPDIR/match_set"
+  run bash_with_match 'cd "'"$BATS_TEST_TMPDIR"'"; match -e foo -e "z$" match_set
+    match -e foo -f match_pats -- match_set; match -f /dev/null match_set || echo "rc=$?"'
+  [ "$status" -eq 0 ]
+  [ "$output" = $'foo\nbaz\nbazz\nfoo\nbar\nbaz\nqux\nrc=1' ]
+}
+
+@test "match: a pattern set reports a limit only where one pattern does" {
+  run bash_with_match 'pats=(); for i in $(seq 100); do pats+=(-e "^x.*y${i}z[0-9]+"); done
+    head -c 20000 /dev/zero | tr "\0" x | match "${pats[@]}" || echo "rc=$?"
+    head -c 100000 /dev/zero | tr "\0" a | match -e "(a|aa)*(a|aa)*b" -e c || echo "rc=$?"'
+  [ "$status" -eq 0 ]
+  [ "$output" = $'rc=1\nmatch: regex execution limit exceeded\nrc=2' ]
+}
+
+@test "match: skipping to a possible first byte keeps matches and limits" {
+  run bash_with_match 'printf "%s\n" "$(head -c 50000 /dev/zero | tr "\0" q)ERROR7" ab | match "(WARN|ERROR)[0-9]" | tail -c 7
+    head -c 999999 /dev/zero | tr "\0" q | match xyz || echo "rc=$?"
+    head -c 1000000 /dev/zero | tr "\0" q | match xyz || echo "rc=$?"
+    printf "ab\nabc\n" | match "a.c|abcd"'
+  [ "$status" -eq 0 ]
+  [ "$output" = $'ERROR7\nrc=1\nmatch: regex execution limit exceeded\nrc=2\nabc' ]
+}
+
+@test "match: literal sets find hits on either side of 64-byte boundaries" {
+  run bash_with_match 'for n in 60 61 62 63 64 65 126 127 128; do printf "%${n}s\n" "" | tr " " q | sed "s/$/ERROR/"; done |
+    match -e WARN -e ERROR -e FATAL | wc -l
+    printf "%200s\n" "" | tr " " E | match -e ERROR -e EXX || echo "rc=$?"'
+  [ "$status" -eq 0 ]
+  [ "$output" = $'9\nrc=1' ]
+}
+
+@test "match: an empty -e or -f pattern selects every line" {
+  run bash_with_match 'match -e "" <<< bar || echo "rc=$?"
+    printf "a\n\nb\n" | match -e x -e "" || echo "rc=$?"
+    printf "foo\n\nbar\n" > "$BATS_TEST_TMPDIR/pats"
+    match -f "$BATS_TEST_TMPDIR/pats" <<< baz || echo "rc=$?"'
+  [ "$status" -eq 0 ]
+  [ "$output" = $'bar\na\n\nb\nbaz' ]
+}
+
+@test "match: literal set members have no execution limit" {
+  run bash_with_match 'head -c 1000000 /dev/zero | tr "\0" q | match xyz || echo "rc=$?"
+    head -c 1000000 /dev/zero | tr "\0" q | match -e xyz -e abc || echo "rc=$?"'
+  [ "$status" -eq 0 ]
+  [ "$output" = $'match: regex execution limit exceeded\nrc=2\nrc=1' ]
+}
+
+@test "match: a file truncated while mapped is a read error, not SIGBUS" {
+  run bash_with_match 'f="$BATS_TEST_TMPDIR/big"
+    for t in 1 4; do
+      seq 1 2000000 > "$f"
+      MATCH_THREADS=$t match 1 "$f" > >(head -c 4096 >/dev/null; : > "$f"; cat >/dev/null) 2>/dev/null || echo "rc=$?"
+    done
+    echo alive'
+  [ "$status" -eq 0 ]
+  [ "$output" = $'rc=2\nrc=2\nalive' ]
+}
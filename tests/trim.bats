@@ -107,3 +107,58 @@ run_trim_od() {
   "
   [ "$status" -eq 2 ]
 }
+
+@test "trim: output larger than the write buffer is complete and ordered" {
+  awk 'BEGIN { for (i=1;i<=50000;i++) printf "  line%d \t\n", i }' >"$F1"
+
+  run bash --noprofile --norc -c "
+    enable -f '$TRIM_SO' trim || exit 99
+    printf 'first\n'
+    trim '$F1' | cksum
+  "
+  [ "$status" -eq 0 ]
+  expected="$(awk 'BEGIN { for (i=1;i<=50000;i++) printf "line%d\n", i }' | cksum)"
+  [ "$output" = "first"$'\n'"$expected" ]
+}
+
+@test "trim: clean runs pass through around dirty, blank and long-padded lines" {
+  awk 'BEGIN {
+    pad = sprintf("%100s", "")
+    for (i = 1; i <= 3000; i++) {
+      if (i % 97 == 0) printf "%s\tx%d%s\n", pad, i, pad
+      else if (i % 89 == 0) printf "\n"
+      else if (i % 83 == 0) printf "y%d \n", i
+      else printf "clean line %d\n", i
+    }
+    printf "tail"
+  }' >"$F1"
+
+  run bash --noprofile --norc -c "
+    enable -f '$TRIM_SO' trim || exit 99
+    trim '$F1' | tail -c 5 | od -An -tx1; trim '$F1' | cksum; cat '$F1' | trim | cksum
+  "
+  [ "$status" -eq 0 ]
+  expected="$(awk '{ sub(/^[ \t\r\v\f]+/, ""); sub(/[ \t\r\v\f]+$/, "") } length($0) { print }' "$F1" | head -c -1 | cksum)"
+  [ "${lines[0]}" = " 0a 74 61 69 6c" ]
+  [ "${lines[1]}" = "$expected" ]
+  [ "${lines[2]}" = "$expected" ]
+}
+
+@test "trim: output is flushed before waiting for more input" {
+  # The writer keeps the FIFO open, so trim must hand over the first line
+  # while it is still waiting for the second (as with `tail -f log | trim`).
+  run bash --noprofile --norc -c "
+    enable -f '$TRIM_SO' trim || exit 99
+    cd '$BATS_TEST_TMPDIR' && mkfifo trim_in trim_out || exit 98
+    exec 3<>trim_in
+    trim <trim_in >trim_out 3>&- &
+    exec 4<trim_out
+    printf '  a b  \\n' >&3
+    IFS= read -r -t 5 line <&4 || line=timeout
+    exec 3>&-
+    wait
+    printf '%s\\n' \"\$line\"
+  "
+  [ "$status" -eq 0 ]
+  [ "$output" = "a b" ]
+}